@@ -5,12 +5,41 @@
 #include "LogFile.h"
 #include "ConfigReader.h"
 #include "Buffer.h"
+#include "CurrentThread.h"
+#include "LogModules.h"
+#include "LogCompress.h"
+#include "Clock.h"
+
+namespace
+{
+
+//close the ring of a thread when it exits, the log thread frees it once drained;
+//a share of it, the AsyncLogging may be gone before the thread
+struct RingHolder
+{
+    ~RingHolder() { if(ring_) ring_->close(); }
+
+    LogRingPtr ring_;
+};
+
+thread_local RingHolder t_ringHolder;
+
+//the rings belong to the first AsyncLogging the thread logs to
+__thread LogRing * t_ring = nullptr;
+
+}
 
 #define MAX_LOG_BUF_SIZE 1024000
 
 AsyncLogging::AsyncLogging(const char * fileName):
+    fileName_(fileName),
+    level_(Logger::INFO),
     running_(true),
-    output_(new LogFile())
+    output_(new LogFile()),
+    ringSize_(DEF_LOG_RING_SIZE),
+    sleeping_(false),
+    deferred_(false),
+    binary_(false)
 {
 
     loadConfig(fileName);
@@ -34,10 +63,25 @@ void AsyncLogging::loadConfig(const char * fileName)
     {
         flushInterval_ = DEF_FLUSHINTERVAL;
     }
-    level_ = cfgFile.GetNameInt("Level", Logger::INFO);
+    loadLevels(cfgFile);
     print_ = cfgFile.GetNameInt("Print", true);
+    int ringSize = cfgFile.GetNameInt("RingSize", DEF_LOG_RING_SIZE);
+    ringSize_ = ringSize > 0 ? ringSize : 0;
+    //the deferred records live in the rings
+    deferred_ = ringSize_ > 0 && (cfgFile.GetNameInt("Deferred", 0) || cfgFile.GetNameInt("Binary", 0));
+    binary_ = deferred_ && cfgFile.GetNameInt("Binary", 0);
 
 
+    //the offset of the local time from utc, "+8", "-3:30" or "local"
+    int offset = DEF_CLOCK_TIMEZONE;
+    std::string strTimezone = cfgFile.GetNameStr("Timezone");
+    if(!strTimezone.empty() && !Clock::parseTimezone(strTimezone, offset))
+    {
+        fprintf(stderr, "bad Timezone=%s in %s, use +8\n", strTimezone.c_str(), fileName);
+        offset = DEF_CLOCK_TIMEZONE;
+    }
+    Clock::setTimezone(offset);
+
     std::string logFolder = cfgFile.GetNameStr("Folder", "log");
     std::string baseName = cfgFile.GetNameStr("Name", "default");
     int rollSize = cfgFile.GetNameInt("RollSize", DEF_ROLLSIZE);
@@ -53,6 +97,48 @@ void AsyncLogging::loadConfig(const char * fileName)
     output_->setRollSize(rollSize);
     output_->setFlushInterval(flushInterval_);
     output_->setAutoRm(autoRm);
+    if(binary_)
+    {
+        output_->setSuffix(".blog");
+    }
+
+    int bufferSize = cfgFile.GetNameInt("BufferSize", DEF_LOG_BUFFER_SIZE/1024);//use KB
+    output_->setBufferSize(bufferSize > 0 ? bufferSize*1024 : DEF_LOG_BUFFER_SIZE);
+    output_->setSync(cfgFile.GetNameInt("Sync", 0) != 0);
+    if(cfgFile.GetNameInt("IoUring", 0) && !output_->setIoUring(true))
+    {
+        fprintf(stderr, "io_uring not supported, the log file is written synchronously\n");
+    }
+
+    int compress = cfgFile.GetNameInt("Compress", 0);//gzip level
+    int compressRate = cfgFile.GetNameInt("CompressRate", DEF_LOG_COMPRESS_RATE);//use MB per second
+    output_->setCompress(compress < LOG_COMPRESS_MAX_LEVEL ? compress : LOG_COMPRESS_MAX_LEVEL, compressRate > 0 ? static_cast<size_t>(compressRate)*1024*1024 : 0);
+}
+
+void AsyncLogging::loadLevels(ConfigReader & cfgFile)
+{
+    level_ = LogModules::parseLevel(cfgFile.GetNameStr("Level"), Logger::INFO);
+
+    std::map<std::string, int> levels;
+    LogModules::parseLevels(cfgFile.GetNameStr("Modules"), levels);
+    LogModules::setLevels(level_, levels);
+}
+
+void AsyncLogging::reloadLevels()
+{
+    ConfigReader cfgFile(fileName_.c_str());
+    loadLevels(cfgFile);
+}
+
+FileNotifyPtr AsyncLogging::watchConfig(EventLoop * loop)
+{
+    FileNotifyPtr notify = MakeFileNotifytPtr(loop);
+    if(!notify->addWatch(fileName_.c_str(), [this](const FileNotifyImpl::FileInfo) { reloadLevels(); }))
+    {
+        return FileNotifyPtr();
+    }
+
+    return notify;
 }
 
 void AsyncLogging::append(LoggerPtr && logger)
@@ -65,58 +151,278 @@ void AsyncLogging::append(LoggerPtr && logger)
     cond_.notify_one();
 }
 
+void AsyncLogging::logFormat(Logger::LogLevel level, const char * file, int line, const char * func, const char * fmt, ...)
+{
+    LogRing * ring = nullptr;
+    LogRecord * record = reserve(ring);
+    if(!record)
+    {
+        va_list arglist;
+        va_start(arglist, fmt);
+        append(std::make_shared<Logger>(level, file, line, func, fmt, arglist));
+        va_end(arglist);
+        return;
+    }
+
+    va_list arglist;
+    va_start(arglist, fmt);
+    int len = vsnprintf(record->msg_, LogRecord::MaxMsgSize, fmt, arglist);
+    va_end(arglist);
+
+    record->kind_ = LOG_RECORD_TEXT;
+    if(len >= 0 && static_cast<size_t>(len) < LogRecord::MaxMsgSize)
+    {
+        record->len_ = static_cast<uint16_t>(len);
+    }
+    else
+    {
+        //too long for the record, format it again into a Logger in its place
+        va_start(arglist, fmt);
+        record->setLarge(new Logger(level, file, line, func, fmt, arglist));
+        va_end(arglist);
+    }
+
+    commit(ring, record, level, file, line, func);
+}
+
+//a full ring waits for the log thread rather than reorder the lines of the thread
+LogRecord * AsyncLogging::reserve(LogRing *& ring)
+{
+    ring = ringSize_ > 0 ? getRing() : nullptr;
+    if(!ring)
+    {
+        return nullptr;
+    }
+
+    LogRecord * record = ring->reserve();
+    while(!record && running_)
+    {
+        cond_.notify_one();
+        std::this_thread::yield();
+        record = ring->reserve();
+    }
+
+    return record;
+}
+
+void AsyncLogging::commit(LogRing * ring, LogRecord * record, Logger::LogLevel level, const char * file, int line, const char * func)
+{
+    record->time_ = Clock::now();
+    record->file_ = file;
+    record->func_ = func;
+    record->line_ = line;
+    record->tid_ = CurrentThread::tid();
+    record->level_ = static_cast<uint16_t>(level);
+
+    if(ring->commit() && sleeping_.load(std::memory_order_relaxed))
+    {
+        cond_.notify_one();
+    }
+}
+
+LogRing * AsyncLogging::getRing()
+{
+    if(t_ring)
+    {
+        return t_ring;
+    }
+
+    LogRingPtr ring = std::make_shared<LogRing>(ringSize_);
+    {
+        std::unique_lock<std::mutex> lock(ringMutex_);
+        rings_.push_back(ring);
+    }
+
+    t_ringHolder.ring_ = ring;
+    t_ring = ring.get();
+    return t_ring;
+}
+
 void AsyncLogging::threadFunc()
 {
+    Buffer outputBuf; // the file log buffer
+    Buffer printBuf; // the screen print buffer
+    std::string data;
+    std::string msg; // the message of a deferred record
+    std::vector<LogRingPtr> rings; // the rings drained in this pass
+
     while(true)
     {
-        LoggerList loggers;
+        bool running = running_;
 
+        bool busy = drainRings(rings, outputBuf, printBuf, data, msg);
+
+        LoggerList loggers;
         {
             std::unique_lock<std::mutex> lock(mutex_);
+            loggers.swap(loggers_);
+        }
 
-            while(loggers_.empty())
-            {
-                if(!running_)
-                {
-                    output_->append("log thread exit!!!\n");
-                    return;
-                }
+        for(auto it = loggers.begin(); it != loggers.end(); ++it)
+        {
+            LoggerPtr & pLogger = *it;
+            pLogger->format(data);
 
-                output_->append(NULL, 0);
-                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            appendLine(outputBuf, data);
+            if((print_ && pLogger->level() == Logger::INFO) || pLogger->raw())
+            {
+                printBuf.append(data.c_str(), data.size());
             }
 
-            loggers.swap(loggers_);
+            output(outputBuf, printBuf, false);
         }
 
+        output(outputBuf, printBuf, true);
+        if(busy || !loggers.empty())
+        {
+            continue;
+        }
 
-        Buffer outputBuf; // the file log buffer
-        Buffer printBuf; // the screen print buffer
-        std::string data;
+        if(!running)
+        {
+            appendLine(outputBuf, "log thread exit!!!\n");
+            output(outputBuf, printBuf, true);
+            return;
+        }
 
-        for(auto it = loggers.begin(); it != loggers.end();)
+        output_->append(NULL, 0);
+
+        //the producers of the rings don't lock, so poll them while idle
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_.store(true);
+        if(loggers_.empty() && running_)
         {
-            LoggerPtr pLogger = *(it++);
-            pLogger->format(data);
+            if(ringSize_ > 0)
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(LOG_RING_POLL_MS));
+            }
+            else
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+        }
+        sleeping_.store(false);
+    }
+}
 
-            outputBuf.append(data.c_str(), data.size());
-            if((print_ && pLogger->level() == Logger::INFO) || pLogger->raw())
+//the lock is only held to copy and prune the list, a new thread doesn't wait for the disk
+bool AsyncLogging::drainRings(std::vector<LogRingPtr> & rings, Buffer & outputBuf, Buffer & printBuf, std::string & data, std::string & msg)
+{
+    bool busy = false;
+    bool drained = false;
+
+    {
+        std::unique_lock<std::mutex> lock(ringMutex_);
+        rings = rings_;
+    }
+
+    for(auto it = rings.begin(); it != rings.end(); ++it)
+    {
+        LogRing * ring = it->get();
+
+        //read it before draining, the last lines of an exited thread are drained now
+        bool closed = ring->closed();
+
+        size_t n = 0;
+        LogRecord * record = nullptr;
+        while(n < ring->capacity() && (record = ring->front()) != nullptr)
+        {
+            bool print = print_ && record->level_ == Logger::INFO;
+            Logger * large = record->large();
+            if(record->kind_ == LOG_RECORD_ARGS)
             {
-                printBuf.append(data.c_str(), data.size());
+                if(binary_)
+                {
+                    binaryWriter_.record(outputBuf, record->time_, record->tid_, record->level_, record->format(),
+                                         record->file_, record->line_, record->func_, record->args(), record->len_);
+                }
+
+                if(!binary_ || print)
+                {
+                    msg.clear();
+                    formatLogArgs(msg, record->format(), record->args(), record->len_);
+                    Logger::format(data, record->time_, static_cast<Logger::LogLevel>(record->level_), record->tid_,
+                                   msg.data(), msg.size(), record->file_, record->line_, record->func_);
+                }
+
+                if(!binary_)
+                {
+                    outputBuf.append(data.c_str(), data.size());
+                }
+            }
+            else if(large)
+            {
+                large->format(data);
+                print = print_ && large->level() == Logger::INFO;
+                delete large;
+                appendLine(outputBuf, data);
+            }
+            else
+            {
+                Logger::format(data, *record);
+                appendLine(outputBuf, data);
             }
+            ring->pop();
+            ++n;
 
-            //write the log buffer to destination
-            if(outputBuf.size() > MAX_LOG_BUF_SIZE || it == loggers.end())
+            if(print)
             {
-                output_->append(outputBuf.data(), outputBuf.size());
-                outputBuf.clear();
+                printBuf.append(data.c_str(), data.size());
             }
 
-            if(printBuf.size() > MAX_LOG_BUF_SIZE || it == loggers.end())
+            output(outputBuf, printBuf, false);
+        }
+
+        busy = busy || n > 0;
+        drained = drained || (closed && ring->front() == nullptr);
+    }
+
+    //the rings of the exited threads, empty for good
+    if(drained)
+    {
+        std::unique_lock<std::mutex> lock(ringMutex_);
+        for(auto it = rings_.begin(); it != rings_.end();)
+        {
+            if((*it)->closed() && (*it)->front() == nullptr)
             {
-                ::fwrite(printBuf.data(), sizeof(char), printBuf.size(), stdout);
-                printBuf.clear();
+                it = rings_.erase(it);
+            }
+            else
+            {
+                ++it;
             }
         }
     }
+
+    rings.clear();
+    return busy;
+}
+
+//a formatted line, framed as text in the binary log
+void AsyncLogging::appendLine(Buffer & outputBuf, const std::string & data)
+{
+    if(binary_)
+    {
+        binaryWriter_.text(outputBuf, data.c_str(), data.size());
+    }
+    else
+    {
+        outputBuf.append(data.c_str(), data.size());
+    }
+}
+
+//write the buffers out when they are large, or whatever they hold if force
+void AsyncLogging::output(Buffer & outputBuf, Buffer & printBuf, bool force)
+{
+    if(outputBuf.size() > MAX_LOG_BUF_SIZE || (force && !outputBuf.empty()))
+    {
+        output_->append(outputBuf.data(), outputBuf.size());
+        outputBuf.clear();
+    }
+
+    if(printBuf.size() > MAX_LOG_BUF_SIZE || (force && !printBuf.empty()))
+    {
+        ::fwrite(printBuf.data(), sizeof(char), printBuf.size(), stdout);
+        printBuf.clear();
+    }
 }
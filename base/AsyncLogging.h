@@ -3,13 +3,24 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <memory>
 #include <condition_variable>
 
 #include "Logger.h"
+#include "LogRing.h"
+#include "LogArgs.h"
+#include "FileNotify.h"
+
 class LogFile;
+class Buffer;
+class EventLoop;
+class ConfigReader;
+
+#define LOG_RING_POLL_MS 100
 
 class AsyncLogging
 {
@@ -23,12 +34,76 @@ public:
     void append(LoggerPtr && logger);
     int getLogLevel() const { return level_; }
 
+    //read Level and Modules from the config file again
+    void reloadLevels();
+
+    //reload the levels when the config file changes, call it in the loop thread
+    //and keep the FileNotify while the loop runs
+    FileNotifyPtr watchConfig(EventLoop * loop);
+
+    /*
+      log through the ring of the calling thread: no lock and no allocation,
+      a message longer than LogRecord::MaxMsgSize is allocated but keeps its
+      place in the ring, a full ring waits for the log thread, so the lines
+      of one thread keep their order
+
+      when Deferred is set only the args are captured, the log thread formats
+      them, or writes them to the binary log when Binary is set, so fmt must
+      be a string literal, the LOG_* macros refuse anything else; the args
+      that don't fit are formatted here
+    */
+    template<size_t N, typename... Args>
+    void log(Logger::LogLevel level, const char * file, int line, const char * func, const char (&fmt)[N], Args... args)
+    {
+        if(deferred_ && logArgs(level, file, line, func, fmt, args...))
+        {
+            return;
+        }
+
+        logFormat(level, file, line, func, fmt, args...);
+    }
+
 private:
+    template<typename... Args>
+    bool logArgs(Logger::LogLevel level, const char * file, int line, const char * func, const char * fmt, Args... args)
+    {
+        LogRing * ring = nullptr;
+        LogRecord * record = reserve(ring);
+        if(!record)
+        {
+            return false;
+        }
+
+        LogArgWriter writer(record->args(), LogRecord::MaxArgsSize);
+        writer.putAll(args...);
+        if(!writer.ok())
+        {
+            return false;
+        }
+
+        record->kind_ = LOG_RECORD_ARGS;
+        record->setFormat(fmt);
+        record->len_ = static_cast<uint16_t>(writer.size());
+        commit(ring, record, level, file, line, func);
+        return true;
+    }
+
+    void logFormat(Logger::LogLevel level, const char * file, int line, const char * func, const char * fmt, ...);
+
+    void loadLevels(ConfigReader & cfgFile);
+
     void threadFunc();
+    LogRing * getRing();
+    LogRecord * reserve(LogRing *& ring);
+    void commit(LogRing * ring, LogRecord * record, Logger::LogLevel level, const char * file, int line, const char * func);
+    bool drainRings(std::vector<LogRingPtr> & rings, Buffer & outputBuf, Buffer & printBuf, std::string & data, std::string & msg);
+    void appendLine(Buffer & outputBuf, const std::string & data);
+    void output(Buffer & outputBuf, Buffer & printBuf, bool force);
 
 private:
     int              flushInterval_;
-    int              level_; // log level
+    std::string      fileName_; // the config file
+    std::atomic<int> level_; // log level
     bool            print_; // print or not
     bool            running_; // just a flag indicate the thread is running
 
@@ -38,6 +113,15 @@ private:
 
     LoggerList                 loggers_; // logger list
     std::unique_ptr<LogFile> output_;
+
+    size_t                     ringSize_; // the records per thread ring, 0 disables the rings
+    std::mutex                 ringMutex_;
+    std::vector<LogRingPtr>    rings_; // the rings of the logging threads
+    std::atomic<bool>          sleeping_; // the log thread waits for lines
+
+    bool                       deferred_; // capture the args, format in the log thread
+    bool                       binary_; // write the deferred records to a binary log
+    LogBinaryWriter            binaryWriter_;
 };
 
 #endif // _ASYNC_LOGGING_H
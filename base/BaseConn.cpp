@@ -1,6 +1,7 @@
 #include "BaseConn.h"
 
 #include <assert.h>
+#include <typeinfo>
 
 #include <event2/event.h>
 #include <event2/bufferevent.h>
@@ -17,6 +18,14 @@ BaseConn::BaseConn(EventLoop * loop):
     bClosed_(false),
     bShutdownd_(false),
     bufev_(nullptr),
+    inputLen_(0),
+    highWatermark_(0),
+    lowWatermark_(0),
+    watermarkPolicy_(WATERMARK_NOTIFY),
+    bOverHigh_(false),
+    evGroup_(nullptr),
+    drainWatermark_(0),
+    sizeSendQueue_(0),
     tie_(nullptr)
 {
     LOG_DEBUG("Create Conn:%p", this);
@@ -28,9 +37,54 @@ BaseConn::~BaseConn()
     LOG_DEBUG("Delete Conn:%p", this);
 }
 
+//batch the pdus, only the first one after a drain queues a functor in the loop
 void BaseConn::sendPdu(const std::shared_ptr<void> & pdu)
 {
-    loop_->runInLoop(std::bind(&BaseConn::onWrite, shared_from_this(), pdu));
+    sendQueue_.push(OutPdu(pdu));
+
+    if(sizeSendQueue_.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        loop_->queueInLoop(std::bind(&BaseConn::sendPduInLoop, shared_from_this()));
+    }
+}
+
+//the buffer is written by reference, so a broadcast doesn't copy the payload per
+//connection; the queue node and the reference holder are still one each
+void BaseConn::sendBuffer(const ConstBufferPtr & buf)
+{
+    sendQueue_.push(OutPdu(buf));
+
+    if(sizeSendQueue_.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        loop_->queueInLoop(std::bind(&BaseConn::sendPduInLoop, shared_from_this()));
+    }
+}
+
+//write all the queued pdus in one pass, so they leave in one flush
+void BaseConn::sendPduInLoop()
+{
+    assert(loop_->isInLoopThread());
+
+    size_t sizeSendQueue = sizeSendQueue_.exchange(0, std::memory_order_acq_rel);
+
+    bool again = sendQueue_.popCounted(sizeSendQueue_, sizeSendQueue, [this](OutPdu & out) {
+        if(out.buf_)
+        {
+            write(out.buf_);
+            out.buf_.reset();
+        }
+        else
+        {
+            onWrite(out.pdu_);
+            out.pdu_.reset();
+        }
+    });
+
+    //the pdus behind a half done push go in the next drain
+    if(again)
+    {
+        loop_->queueInLoop(std::bind(&BaseConn::sendPduInLoop, shared_from_this()));
+    }
 }
 
 bool BaseConn::read(std::vector<char> & data)
@@ -107,6 +161,74 @@ bool BaseConn::read(void * data, size_t datlen)
     return true;
 }
 
+size_t BaseConn::readable()
+{
+    loop_->assertInLoopThread();
+    assert(bufev_ != nullptr);
+
+    return evbuffer_get_length(bufferevent_get_input(bufev_));
+}
+
+//fill vecs with the input chunks that cover datlen bytes(all the input if 0)
+int BaseConn::peek(std::vector<struct iovec> & vecs, size_t datlen)
+{
+    loop_->assertInLoopThread();
+    assert(bufev_ != nullptr);
+
+    struct evbuffer * inputBuffer = bufferevent_get_input(bufev_);
+    ev_ssize_t len = datlen > 0 ? static_cast<ev_ssize_t>(datlen) : -1;
+
+    int n = evbuffer_peek(inputBuffer, len, nullptr, nullptr, 0);
+    if(n <= 0)
+    {
+        vecs.clear();
+        return 0;
+    }
+
+    vecs.resize(n);
+    n = evbuffer_peek(inputBuffer, len, nullptr, vecs.data(), n);
+    vecs.resize(n);
+    return n;
+}
+
+//return a contiguous view of the first datlen bytes, pullup only if the
+//bytes straddle chunks, the view is valid until the next consume/read
+const char * BaseConn::peek(size_t datlen)
+{
+    loop_->assertInLoopThread();
+    assert(bufev_ != nullptr);
+
+    struct evbuffer * inputBuffer = bufferevent_get_input(bufev_);
+    if(datlen == 0 || evbuffer_get_length(inputBuffer) < datlen)
+    {
+        //input buffer not enough
+        return nullptr;
+    }
+
+    struct evbuffer_iovec vec;
+    if(evbuffer_peek(inputBuffer, datlen, nullptr, &vec, 1) >= 1 && vec.iov_len >= datlen)
+    {
+        return static_cast<const char *>(vec.iov_base);
+    }
+
+    return reinterpret_cast<const char *>(evbuffer_pullup(inputBuffer, datlen));
+}
+
+bool BaseConn::consume(size_t datlen)
+{
+    loop_->assertInLoopThread();
+    assert(bufev_ != nullptr);
+
+    struct evbuffer * inputBuffer = bufferevent_get_input(bufev_);
+    if(evbuffer_get_length(inputBuffer) < datlen)
+    {
+        return false;
+    }
+
+    ASSERT_ABORT(evbuffer_drain(inputBuffer, datlen) == 0);
+    return true;
+}
+
 bool BaseConn::write(void * data, size_t datlen)
 {
     loop_->assertInLoopThread();
@@ -116,6 +238,11 @@ bool BaseConn::write(void * data, size_t datlen)
     }
 
     assert(bufev_ != nullptr);
+    if(bOverHigh_ && watermarkPolicy_ == WATERMARK_DROP)
+    {
+        return false;
+    }
+
     if(bufferevent_write(bufev_, data, datlen) != 0)
     {
         LOG_ERROR("write errno=%d, error:%s", errno, strerror(errno));
@@ -123,7 +250,7 @@ bool BaseConn::write(void * data, size_t datlen)
         return false;
     }
 
-    return true;
+    return afterWrite(datlen);
 }
 
 bool BaseConn::write(void * data1, size_t datlen1, void * data2, size_t datlen2)
@@ -135,13 +262,270 @@ bool BaseConn::write(void * data1, size_t datlen1, void * data2, size_t datlen2)
     }
 
     assert(bufev_ != nullptr);
+    if(bOverHigh_ && watermarkPolicy_ == WATERMARK_DROP)
+    {
+        return false;
+    }
+
     struct evbuffer * buf = bufferevent_get_output(bufev_);
     ASSERT_ABORT(evbuffer_expand(buf, datlen1+datlen2) == 0);
     ASSERT_ABORT(evbuffer_add(buf, data1, datlen1) == 0);
     ASSERT_ABORT(evbuffer_add(buf, data2, datlen2) == 0);
+    return afterWrite(datlen1+datlen2);
+}
+
+bool BaseConn::write(const std::shared_ptr<const void> & owner, const void * data, size_t datlen)
+{
+    loop_->assertInLoopThread();
+    if(!connected())
+    {
+        return false;
+    }
+
+    assert(bufev_ != nullptr);
+    if(bOverHigh_ && watermarkPolicy_ == WATERMARK_DROP)
+    {
+        return false;
+    }
+
+    if(datlen == 0)
+    {
+        return true;
+    }
+
+    //the holder is freed by release_cb when libevent drains the bytes
+    std::shared_ptr<const void> * holder = new std::shared_ptr<const void>(owner);
+    struct evbuffer * buf = bufferevent_get_output(bufev_);
+    if(evbuffer_add_reference(buf, data, datlen, release_cb, holder) != 0)
+    {
+        delete holder;
+        LOG_ERROR("write errno=%d, error:%s", errno, strerror(errno));
+        close();
+        return false;
+    }
+
+    return afterWrite(datlen);
+}
+
+bool BaseConn::write(const ConstBufferPtr & buf)
+{
+    return write(buf, buf->data(), buf->size());
+}
+
+void BaseConn::setWriteWatermark(size_t highWatermark, size_t lowWatermark, int policy)
+{
+    highWatermark_ = highWatermark;
+    lowWatermark_ = highWatermark > 0 ? MIN_VALUE(lowWatermark, highWatermark) : lowWatermark;
+    watermarkPolicy_ = policy;
+
+    //before the connection is built the watermark is set by BuildAccept/BuildConnect
+    if(bufev_)
+    {
+        loop_->assertInLoopThread();
+        updateWriteWatermark();
+    }
+}
+
+//called after every write, false if the connection is going to close
+bool BaseConn::afterWrite(size_t datlen)
+{
+    statAdd(stats_.writes_, 1);
+    statAdd(stats_.bytesOut_, datlen);
+    statAdd(loop_->stats_.writes_, 1);
+    statAdd(loop_->stats_.bytesOut_, datlen);
+
+    if(rateLimit_ && bufferevent_get_write_limit(bufev_) <= 0)
+    {
+        rateLimit_->addWriteThrottled();
+    }
+
+    if(evGroup_ && bufferevent_rate_limit_group_get_write_limit(evGroup_) <= 0)
+    {
+        rateLimitGroup_->addWriteThrottled();
+    }
+
+    if(highWatermark_ == 0 || bOverHigh_)
+    {
+        return true;
+    }
+
+    size_t outputLen = evbuffer_get_length(bufferevent_get_output(bufev_));
+    if(outputLen <= highWatermark_)
+    {
+        return true;
+    }
+
+    bOverHigh_ = true;
+    onHighWatermark(outputLen);
+
+    if(watermarkPolicy_ == WATERMARK_STOP_READ)
+    {
+        bufferevent_disable(bufev_, EV_READ);
+    }
+    else if(watermarkPolicy_ == WATERMARK_CLOSE)
+    {
+        LOG_WARN("output over high watermark, this=%p, fd=%d, output=%d", this, connInfo_.fd(), static_cast<int>(outputLen));
+        close();
+        return false;
+    }
+
     return true;
 }
 
+void BaseConn::checkLowWatermark()
+{
+    if(!bOverHigh_ || bufev_ == nullptr)
+    {
+        return;
+    }
+
+    if(evbuffer_get_length(bufferevent_get_output(bufev_)) > lowWatermark_)
+    {
+        return;
+    }
+
+    bOverHigh_ = false;
+    if(watermarkPolicy_ == WATERMARK_STOP_READ)
+    {
+        bufferevent_enable(bufev_, EV_READ);
+    }
+
+    onWriteDrained();
+}
+
+//the write callback runs once the output falls to the larger of the watermarks
+void BaseConn::updateWriteWatermark()
+{
+    size_t lowWatermark = lowWatermark_;
+    if(drainWaiter_)
+    {
+        lowWatermark = MAX_VALUE(lowWatermark, drainWatermark_);
+    }
+
+    bufferevent_setwatermark(bufev_, EV_WRITE, lowWatermark, 0);
+}
+
+void BaseConn::setRateLimit(const RateLimitPtr & limit)
+{
+    rateLimit_ = limit;
+    if(bufev_)
+    {
+        loop_->assertInLoopThread();
+        applyRateLimit();
+    }
+}
+
+void BaseConn::setRateLimitGroup(const RateLimitGroupPtr & group)
+{
+    rateLimitGroup_ = group;
+    if(bufev_)
+    {
+        loop_->assertInLoopThread();
+        applyRateLimit();
+    }
+}
+
+void BaseConn::applyRateLimit()
+{
+    bufferevent_set_rate_limit(bufev_, rateLimit_ ? rateLimit_->cfg() : nullptr);
+
+    if(!rateLimitGroup_)
+    {
+        rateLimitGroup_ = RateLimitGroup::getTypeGroup(connInfo_.type());
+    }
+
+    if(rateLimitGroup_)
+    {
+        evGroup_ = rateLimitGroup_->getGroup(loop_);
+        bufferevent_add_to_rate_limit_group(bufev_, evGroup_);
+    }
+    else if(evGroup_)
+    {
+        bufferevent_remove_from_rate_limit_group(bufev_);
+        evGroup_ = nullptr;
+    }
+}
+
+void BaseConn::setCodec(const FrameCodec & codec)
+{
+    codec_.reset(new FrameCodec(codec));
+}
+
+bool BaseConn::writeFrame(const void * data, size_t datlen)
+{
+    assert(codec_);
+
+    char header[FrameCodec::MaxHeaderSize];
+    size_t headerLen = codec_->encode(header, datlen);
+    if(!codec_->fits(headerLen, datlen))
+    {
+        LOG_ERROR("frame too large, this=%p, fd=%d, size=%d, maxFrameSize=%d", this, connInfo_.fd(), static_cast<int>(datlen), static_cast<int>(codec_->maxFrameSize()));
+        return false;
+    }
+
+    return write(header, headerLen, const_cast<void *>(data), datlen);
+}
+
+//pass every complete frame of this read event to onMessage, in place
+void BaseConn::readFrames()
+{
+    assert(loop_->isInLoopThread());
+
+    char header[FrameCodec::MaxHeaderSize];
+    while(bufev_ != nullptr && !closed())
+    {
+        struct evbuffer * inputBuffer = bufferevent_get_input(bufev_);
+        size_t inputLen = evbuffer_get_length(inputBuffer);
+        if(inputLen == 0)
+        {
+            break;
+        }
+
+        size_t headerLen = 0;
+        size_t frameLen = 0;
+        ev_ssize_t n = evbuffer_copyout(inputBuffer, header, MIN_VALUE(inputLen, sizeof(header)));
+        int ret = codec_->decode(header, static_cast<size_t>(n), headerLen, frameLen);
+        if(ret == FrameCodec::DECODE_MORE)
+        {
+            break;
+        }
+
+        if(ret == FrameCodec::DECODE_ERROR)
+        {
+            LOG_ERROR("bad frame, this=%p, fd=%d, maxFrameSize=%d", this, connInfo_.fd(), static_cast<int>(codec_->maxFrameSize()));
+            close();
+            break;
+        }
+
+        if(inputLen < frameLen)
+        {
+            //input buffer not enough
+            break;
+        }
+
+        const char * frame = peek(frameLen);
+        onMessage(FrameView(frame, frameLen, headerLen));
+        ASSERT_ABORT(evbuffer_drain(inputBuffer, frameLen) == 0);
+    }
+}
+
+void BaseConn::setDrainWaiter(size_t lowWatermark, Task && waiter)
+{
+    loop_->assertInLoopThread();
+    drainWaiter_ = std::move(waiter);
+    drainWatermark_ = lowWatermark;
+    if(bufev_)
+    {
+        updateWriteWatermark();
+    }
+}
+
+size_t BaseConn::outputLength()
+{
+    loop_->assertInLoopThread();
+    return bufev_ ? evbuffer_get_length(bufferevent_get_output(bufev_)) : 0;
+}
+
 void BaseConn::close()
 {
     //queue in loop is right, or ahaha
@@ -189,6 +573,12 @@ void BaseConn::onEvent(short what)
 void BaseConn::connectInLoop()
 {
     assert(loop_->isInLoopThread());
+    if(!bConnected_)
+    {
+        ++loop_->connCount_;
+        statAdd(loop_->stats_.connOpened_, 1);
+        stats_.connectTime_.store(TimeStamp::now().microseconds(), std::memory_order_relaxed);
+    }
     bConnected_ = true;
     if(connect_cb_)
     {
@@ -223,14 +613,35 @@ void BaseConn::closeInLoop()
     {
         bufferevent_free(bufev_);
         bufev_ = nullptr;
+        evGroup_ = nullptr;
+        inputLen_ = 0;
     }
 
     //you can use weakptr,but it too complicate, so you have to free manual
     setConnectCallback(ConnCallback());
     setCloseCallback(ConnCallback());
 
+    if(bConnected_)
+    {
+        --loop_->connCount_;
+        statAdd(loop_->stats_.connClosed_, 1);
+    }
+    stats_.closeTime_.store(TimeStamp::now().microseconds(), std::memory_order_relaxed);
     bClosed_ = true;
     bConnected_ = false;
+    bOverHigh_ = false;
+
+    //wake the coroutines up, they see closed()
+    if(readWaiter_)
+    {
+        Task waiter(std::move(readWaiter_));
+        waiter();
+    }
+    if(drainWaiter_)
+    {
+        Task waiter(std::move(drainWaiter_));
+        waiter();
+    }
     tie_.reset();
 }
 
@@ -248,7 +659,9 @@ void BaseConn::BuildAccept()
             break;
         }
 
-        bufferevent_setcb(bufev_, read_cb, nullptr, event_cb, this);
+        bufferevent_setcb(bufev_, read_cb, write_cb, event_cb, this);
+        updateWriteWatermark();
+        applyRateLimit();
         int ret = 0;
         ret = bufferevent_enable(bufev_, EV_READ|EV_WRITE|EV_PERSIST|EV_ET);
         if(ret != 0)
@@ -278,7 +691,9 @@ void BaseConn::BuildConnect()
             break;
         }
 
-        bufferevent_setcb(bufev_, read_cb, nullptr, event_cb, this);
+        bufferevent_setcb(bufev_, read_cb, write_cb, event_cb, this);
+        updateWriteWatermark();
+        applyRateLimit();
 
         int ret = 0;
         ret = bufferevent_enable(bufev_, EV_READ|EV_WRITE|EV_PERSIST|EV_ET);
@@ -307,14 +722,81 @@ void BaseConn::BuildConnect()
 }
 
 void BaseConn::read_cb(struct bufferevent * bev, void * ctx)
+{
+    BaseConn * conn = static_cast<BaseConn *>(ctx);
+    EventLoop * loop = conn->loop_;
+    loop->enterCallback(TimeStamp::now().microseconds(), typeid(*conn).name(), "onRead");
+
+    //the input grew by the bytes libevent just read
+    size_t inputLen = evbuffer_get_length(bufferevent_get_input(bev));
+    size_t bytesIn = inputLen > conn->inputLen_ ? inputLen - conn->inputLen_ : 0;
+    statAdd(conn->stats_.reads_, 1);
+    statAdd(conn->stats_.bytesIn_, bytesIn);
+    statAdd(loop->stats_.reads_, 1);
+    statAdd(loop->stats_.bytesIn_, bytesIn);
+
+    if(conn->readWaiter_)
+    {
+        Task waiter(std::move(conn->readWaiter_));
+        waiter();
+    }
+    else if(conn->codec_)
+    {
+        conn->readFrames();
+    }
+    else
+    {
+        conn->onRead();
+    }
+
+    if(conn->bufev_)
+    {
+        conn->inputLen_ = evbuffer_get_length(bufferevent_get_input(conn->bufev_));
+
+        if(conn->rateLimit_ && bufferevent_get_read_limit(conn->bufev_) <= 0)
+        {
+            conn->rateLimit_->addReadThrottled();
+        }
+
+        if(conn->evGroup_ && bufferevent_rate_limit_group_get_read_limit(conn->evGroup_) <= 0)
+        {
+            conn->rateLimitGroup_->addReadThrottled();
+        }
+    }
+    loop->leaveCallback(TimeStamp::now().microseconds());
+}
+
+void BaseConn::write_cb(struct bufferevent * bev, void * ctx)
 {
     NOTUSED_ARG(bev);
-    static_cast<BaseConn *>(ctx)->onRead();
+    BaseConn * conn = static_cast<BaseConn *>(ctx);
+    conn->checkLowWatermark();
+
+    if(conn->drainWaiter_ && conn->outputLength() <= conn->drainWatermark_)
+    {
+        Task waiter(std::move(conn->drainWaiter_));
+        waiter();
+
+        if(!conn->drainWaiter_ && conn->bufev_)
+        {
+            conn->updateWriteWatermark();
+        }
+    }
 }
 
 void BaseConn::event_cb(struct bufferevent * bev, short what, void * ctx)
 {
     NOTUSED_ARG(bev);
-    static_cast<BaseConn *>(ctx)->onEvent(what);
+    BaseConn * conn = static_cast<BaseConn *>(ctx);
+    EventLoop * loop = conn->loop_;
+    loop->enterCallback(TimeStamp::now().microseconds(), typeid(*conn).name(), "onEvent");
+    conn->onEvent(what);
+    loop->leaveCallback(TimeStamp::now().microseconds());
 }
 
+void BaseConn::release_cb(const void * data, size_t datlen, void * arg)
+{
+    NOTUSED_ARG(data);
+    NOTUSED_ARG(datlen);
+    delete static_cast<std::shared_ptr<const void> *>(arg);
+}
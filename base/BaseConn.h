@@ -4,11 +4,21 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <sys/uio.h>
 
 #include "ConnInfo.h"
+#include "MpscQueue.h"
+#include "Buffer.h"
+#include "FrameCodec.h"
+#include "Task.h"
+#include "RateLimit.h"
+#include "Metrics.h"
 
 class BaseConn;
 class EventLoop;
+class ConnReadAwaiter;
+class ConnDrainAwaiter;
 
 typedef std::shared_ptr<BaseConn> BaseConnPtr;
 typedef std::map<uint32_t,  BaseConnPtr> ConnMap_t;
@@ -17,18 +27,66 @@ typedef std::function<void (const BaseConnPtr &)> ConnCallback;
 class BaseConn:public std::enable_shared_from_this<BaseConn>
 {
 public:
+    //what to do while the output is over the high watermark
+    enum
+    {
+        WATERMARK_NOTIFY = 0, // only call onHighWatermark
+        WATERMARK_STOP_READ, // stop reading the peer until the output drains
+        WATERMARK_DROP, // refuse the writes until the output drains
+        WATERMARK_CLOSE // close the connection
+    };
+
     BaseConn(EventLoop * loop);
     virtual ~BaseConn();
 
 public:
     void sendPdu(const std::shared_ptr<void> & pdu);
+    void sendBuffer(const ConstBufferPtr & buf); // buf is shared, don't modify it after sending
 
     bool read(std::vector<char> & data);
     bool read(std::vector<char> & data, size_t datlen);
     bool read(void * data, size_t datlen);
+
+    //zero copy read: peek the input chunks in place, then consume them
+    size_t readable();
+    int peek(std::vector<struct iovec> & vecs, size_t datlen = 0);
+    const char * peek(size_t datlen);
+    bool consume(size_t datlen);
+
     bool write(void * data, size_t datlen);
     bool write(void * data1, size_t datlen1, void * data2, size_t datlen2);
 
+    //zero copy write: the output references the bytes and holds owner until they are sent,
+    //that takes a heap copy of owner besides the chain libevent allocates for the reference
+    bool write(const std::shared_ptr<const void> & owner, const void * data, size_t datlen);
+    bool write(const ConstBufferPtr & buf);
+
+    //backpressure: onHighWatermark once the output grows over highWatermark,
+    //onWriteDrained once it falls back to lowWatermark, 0 high means no limit
+    void setWriteWatermark(size_t highWatermark, size_t lowWatermark = 0, int policy = WATERMARK_NOTIFY);
+    inline bool overHighWatermark() const { return bOverHigh_; }
+
+    //token bucket limits: the conn owns the buckets of limit and shares those of
+    //group, without a group it joins RateLimitGroup::getTypeGroup(type) if any
+    void setRateLimit(const RateLimitPtr & limit);
+    void setRateLimitGroup(const RateLimitGroupPtr & group);
+
+    //framing: with a codec the complete frames are passed to onMessage instead of onRead,
+    //writeFrame() refuses a frame larger than the maxFrameSize of the codec
+    void setCodec(const FrameCodec & codec);
+    bool writeFrame(const void * data, size_t datlen);
+
+    //C++20 coroutines, include Coroutine.h to use them
+    ConnReadAwaiter readExactly(size_t datlen);
+    ConnDrainAwaiter drain(size_t lowWatermark = 0);
+
+    //one shot hooks for the awaiters, called in the loop thread: the read waiter
+    //replaces onRead for one read event, the drain waiter runs when the output
+    //falls to lowWatermark, both run on close too
+    void setReadWaiter(Task && waiter) { readWaiter_ = std::move(waiter); }
+    void setDrainWaiter(size_t lowWatermark, Task && waiter);
+    size_t outputLength();
+
     void close();
     void shutdown();
 
@@ -40,6 +98,7 @@ public:
     inline bool closed() const { return bClosed_; }
     inline bool shutdownd() const { return bShutdownd_; }
     inline const ConnInfo & getConnInfo() const { return connInfo_; }
+    inline const ConnStats & stats() const { return stats_; }
 
     void setConnectCallback(const ConnCallback & cb) { connect_cb_ = cb; }
     void setCloseCallback(const ConnCallback & cb) { close_cb_ = cb; }
@@ -48,7 +107,10 @@ protected:
     virtual void onConnect() {}
     virtual void onClose() {}
     virtual void onRead() {};
+    virtual void onMessage(const FrameView &) {}
     virtual void onWrite(const std::shared_ptr<void> &) {}
+    virtual void onHighWatermark(size_t) {}
+    virtual void onWriteDrained() {}
 
 private:
     void BuildAccept();
@@ -56,11 +118,30 @@ private:
 
     void connectInLoop();
     void closeInLoop();
+    void sendPduInLoop();
+    void readFrames();
+    bool afterWrite(size_t datlen);
+    void applyRateLimit();
+    void checkLowWatermark();
+    void updateWriteWatermark();
     void onEvent(short what);
 
     static void read_cb(struct bufferevent * bev, void * ctx);
+    static void write_cb(struct bufferevent * bev, void * ctx);
     static void event_cb(struct bufferevent * bev, short what, void * ctx);
+    static void release_cb(const void * data, size_t datlen, void * arg);
 private:
+    //a queued pdu, or a buffer written by reference if buf_ is set
+    struct OutPdu
+    {
+        OutPdu() {}
+        explicit OutPdu(const std::shared_ptr<void> & pdu):pdu_(pdu) {}
+        explicit OutPdu(const ConstBufferPtr & buf):buf_(buf) {}
+
+        std::shared_ptr<void> pdu_;
+        ConstBufferPtr buf_;
+    };
+
     EventLoop * loop_; // the event loop
     bool bConnected_; // the connect flag
     bool bClosed_; // the close flag
@@ -68,11 +149,31 @@ private:
     ConnInfo connInfo_; // the connection infomation
 
     struct bufferevent * bufev_; // the libevent buffer event
+    size_t inputLen_; // the input left by the last read callback
+    ConnStats stats_;
 
     ConnCallback connect_cb_; // register the connet callback
     ConnCallback close_cb_; // register the close callback
     ConnCallback message_cb_;
 
+    std::unique_ptr<FrameCodec> codec_; // null if the subclass reads by itself
+
+    size_t highWatermark_; // the output limit, 0 if unlimited
+    size_t lowWatermark_; // the output size to resume at
+    int watermarkPolicy_;
+    bool bOverHigh_; // the output is over the high watermark
+
+    RateLimitPtr rateLimit_; // the buckets of this conn
+    RateLimitGroupPtr rateLimitGroup_; // the shared buckets
+    struct bufferevent_rate_limit_group * evGroup_; // the buckets of rateLimitGroup_ on loop_
+
+    Task readWaiter_; // the coroutine waiting for input
+    Task drainWaiter_; // the coroutine waiting for the output to drain
+    size_t drainWatermark_; // the output size the drain waiter waits for
+
+    MpscQueue<OutPdu> sendQueue_; // the outbound pdu queue
+    std::atomic<size_t> sizeSendQueue_; // pdus queued since the last drain
+
     //tie 'this', so can't free object manual
     std::shared_ptr<void> tie_;
 };
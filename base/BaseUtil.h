@@ -2,6 +2,7 @@
 #define _BASE_UTIL_H_
 
 #include "AsyncLogging.h"
+#include "LogModules.h"
 #include "FileNotify.h"
 #include "BaseConn.h"
 #include "EventLoop.h"
@@ -29,12 +30,25 @@
 #if 1
 
 #define LOG_RAW(fmt, args...)   getLogger().append(MakeLoggerPtr(fmt, ##args))
-#define LOG_TRACE(fmt, args...)  if(getLogger().getLogLevel() <= Logger::TRACE) getLogger().append(MakeLoggerPtr(Logger::TRACE, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
-#define LOG_DEBUG(fmt, args...)  if(getLogger().getLogLevel() <= Logger::DEBUG) getLogger().append(MakeLoggerPtr(Logger::DEBUG, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
-#define LOG_INFO(fmt, args...)   if(getLogger().getLogLevel() <= Logger::INFO) getLogger().append(MakeLoggerPtr(Logger::INFO, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
-#define LOG_WARN(fmt, args...)   getLogger().append(MakeLoggerPtr(Logger::WARN, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
-#define LOG_ERROR(fmt, args...)  getLogger().append(MakeLoggerPtr(Logger::ERROR, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
-#define LOG_FATAL(fmt, args...)  getLogger().append(MakeLoggerPtr(Logger::FATAL, __FILE__, __LINE__, __FUNCTION__, fmt, ##args))
+//the levels under LOG_MIN_LEVEL are compiled out, build with -DLOG_MIN_LEVEL=2 to drop TRACE and DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+//the runtime level of the module of the call site, see LogModules
+//the macros are expressions, so an else after them binds to the caller's if
+#define LOG_ENABLED(level) (LOG_MIN_LEVEL <= level && ({ static std::atomic<int> logModule(-1); LogModules::enabled(logModule, __FILE__, level); }))
+
+//a deferred line keeps only the fmt pointer, so fmt must be a string literal: this
+//doesn't compile for anything else, log a buffer with LOG_INFO("%s", buf)
+#define LOG_LITERAL(fmt) ("" fmt)
+
+#define LOG_TRACE(fmt, args...)  (LOG_ENABLED(Logger::TRACE) ? getLogger().log(Logger::TRACE, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
+#define LOG_DEBUG(fmt, args...)  (LOG_ENABLED(Logger::DEBUG) ? getLogger().log(Logger::DEBUG, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
+#define LOG_INFO(fmt, args...)   (LOG_ENABLED(Logger::INFO) ? getLogger().log(Logger::INFO, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
+#define LOG_WARN(fmt, args...)   (LOG_MIN_LEVEL <= Logger::WARN ? getLogger().log(Logger::WARN, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
+#define LOG_ERROR(fmt, args...)  (LOG_MIN_LEVEL <= Logger::ERROR ? getLogger().log(Logger::ERROR, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
+#define LOG_FATAL(fmt, args...)  (LOG_MIN_LEVEL <= Logger::FATAL ? getLogger().log(Logger::FATAL, __FILE__, __LINE__, __FUNCTION__, LOG_LITERAL(fmt), ##args) : (void)0)
 
 #else
 
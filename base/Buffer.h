@@ -6,6 +6,7 @@
 
 class Buffer;
 typedef std::shared_ptr<Buffer> BufferPtr;
+typedef std::shared_ptr<const Buffer> ConstBufferPtr;
 #define MakeBufferPtr std::make_shared<Buffer>
 
 /*
@@ -19,10 +20,11 @@ public:
 public:
     char * data() { return buf_.data(); }
     char * data(size_t len) { return buf_.data()+len; }
+    const char * data() const { return buf_.data(); }
 
     void clear() { buf_.clear(); }
-    bool empty() { return buf_.empty(); }
-    size_t size() { return buf_.size(); }
+    bool empty() const { return buf_.empty(); }
+    size_t size() const { return buf_.size(); }
     void resize(size_t len) { buf_.resize(len); }
     void reserve(size_t len) { buf_.reserve(len); }
 
@@ -0,0 +1,101 @@
+#include "Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+std::atomic<int> Clock::timezone_(DEF_CLOCK_TIMEZONE);
+
+namespace
+{
+
+//the rendered local second of this thread
+__thread time_t t_lastSecond;
+__thread char t_second[32];
+__thread size_t t_secondLen;
+
+}
+
+bool Clock::parseTimezone(const std::string & str, int & offset)
+{
+    if(str == "local")
+    {
+        time_t now = ::time(nullptr);
+        struct tm tmtime;
+        localtime_r(&now, &tmtime);
+        offset = static_cast<int>(tmtime.tm_gmtoff);
+        return true;
+    }
+
+    const char * p = str.c_str();
+    int sign = 1;
+    if(*p == '+' || *p == '-')
+    {
+        sign = *p == '-' ? -1 : 1;
+        ++p;
+    }
+
+    if(!isdigit(static_cast<unsigned char>(*p)))
+    {
+        return false;
+    }
+
+    char * end = nullptr;
+    long hours = strtol(p, &end, 10);
+    long minutes = 0;
+    if(*end == ':')
+    {
+        p = end + 1;
+        if(!isdigit(static_cast<unsigned char>(*p)))
+        {
+            return false;
+        }
+        minutes = strtol(p, &end, 10);
+    }
+
+    if(*end != '\0' || hours > 14 || minutes >= 60)
+    {
+        return false;
+    }
+
+    offset = static_cast<int>(sign*(hours*3600 + minutes*60));
+    return true;
+}
+
+size_t Clock::formatTime(int64_t microseconds, char * buf, size_t len)
+{
+    time_t seconds = toLocal(static_cast<time_t>(microseconds/1000000));
+    int micro = static_cast<int>(microseconds%1000000);
+    if(seconds != t_lastSecond || t_secondLen == 0)
+    {
+        t_lastSecond = seconds;
+        struct tm tmtime;
+        gmtime_r(&seconds, &tmtime);
+        int n = snprintf(t_second, sizeof(t_second), "%4d%02d%02d %02d:%02d:%02d.",
+                         tmtime.tm_year + 1900, tmtime.tm_mon + 1, tmtime.tm_mday,
+                         tmtime.tm_hour, tmtime.tm_min, tmtime.tm_sec);
+        t_secondLen = n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+    size_t total = t_secondLen + 6;
+    if(len <= total)
+    {
+        if(len > 0)
+        {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+
+    memcpy(buf, t_second, t_secondLen);
+    char * p = buf + total;
+    *p = '\0';
+    for(int i = 0; i < 6; ++i)
+    {
+        *--p = static_cast<char>('0' + micro%10);
+        micro /= 10;
+    }
+
+    return total;
+}
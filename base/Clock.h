@@ -0,0 +1,57 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string>
+#include <atomic>
+
+#define DEF_CLOCK_TIMEZONE 8*3600
+#define CLOCK_TIME_LEN 24 // "20260118 10:20:30.123456"
+
+/*
+   Clock: the process wide clock
+
+   now() and monotonic() are clock_gettime through the vDSO, no syscall;
+   coarse() is CLOCK_REALTIME_COARSE, the time the kernel caches at every
+   tick, a few ms behind at most and cheaper still, for the second and the
+   millisecond stamps
+
+   the local time is the utc time plus a fixed offset, Timezone in log.conf,
+   +8 unless set. formatTime() renders the date and time of a second once per
+   thread and only writes the microseconds of the lines in the same second
+ */
+class Clock
+{
+public:
+    //microseconds since the epoch
+    static int64_t now() { return read(CLOCK_REALTIME); }
+    static int64_t coarse() { return read(CLOCK_REALTIME_COARSE); }
+
+    //microseconds since boot, for the intervals
+    static int64_t monotonic() { return read(CLOCK_MONOTONIC); }
+
+    //seconds east of utc
+    static int getTimezone() { return timezone_.load(std::memory_order_relaxed); }
+    static void setTimezone(int offset) { timezone_.store(offset, std::memory_order_relaxed); }
+
+    //"+8", "-3:30" or "local" for the offset of the system now, false if malformed
+    static bool parseTimezone(const std::string & str, int & offset);
+
+    static time_t toLocal(time_t seconds) { return seconds + getTimezone(); }
+
+    //the local "%Y%m%d %H:%M:%S.micro" of microseconds since the epoch, return its length
+    static size_t formatTime(int64_t microseconds, char * buf, size_t len);
+private:
+    static int64_t read(clockid_t id)
+    {
+        struct timespec ts;
+        clock_gettime(id, &ts);
+        return static_cast<int64_t>(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+    }
+
+    static std::atomic<int> timezone_;
+};
+
+#endif // _CLOCK_H_
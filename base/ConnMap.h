@@ -8,7 +8,9 @@
 #include <memory>
 
 class BaseConn;
+class Buffer;
 typedef std::shared_ptr<BaseConn> BaseConnPtr;
+typedef std::shared_ptr<const Buffer> ConstBufferPtr;
 
 template<typename T>
 class ConnMap
@@ -104,6 +106,17 @@ public:
         }
     }
 
+    //broadcast one buffer by reference, the payload is not copied, but each
+    //connection still allocates a queue node and the holder of its reference
+    void sendBuffer(const ConstBufferPtr & buf)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(auto it = connMap_.begin(); it != connMap_.end(); ++it)
+        {
+            (it->second)->sendBuffer(buf);
+        }
+    }
+
     size_t size() { return connMap_.size(); }
 
     void getAllConn(ConnList_t & connList)
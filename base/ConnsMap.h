@@ -8,7 +8,9 @@
 #include <memory>
 
 class BaseConn;
+class Buffer;
 typedef std::shared_ptr<BaseConn> BaseConnPtr;
+typedef std::shared_ptr<const Buffer> ConstBufferPtr;
 
 template<typename T>
 class ConnsMap
@@ -56,6 +58,17 @@ public:
         }
     }
 
+    //broadcast one buffer by reference, the payload is not copied, but each
+    //connection still allocates a queue node and the holder of its reference
+    void sendBuffer(const T & key, const ConstBufferPtr & buf)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(auto it = connsMap_[key].begin(); it != connsMap_[key].end(); ++it)
+        {
+            (*it)->sendBuffer(buf);
+        }
+    }
+
     size_t size()
     {
         return connsMap_.size();
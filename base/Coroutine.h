@@ -0,0 +1,171 @@
+#ifndef _COROUTINE_H_
+#define _COROUTINE_H_
+
+/*
+   C++20 coroutines on top of BaseConn and EventLoop, opt-in: only the code
+   including this header needs -std=c++20, the rest of the library stays C++11
+
+   a coroutine resumes in the loop thread that owns the awaited object, from
+   the libevent callback itself, so there is no extra queueInLoop hop
+
+   CoTask onConnect()
+   {
+       std::vector<char> header = co_await conn->readExactly(4);
+       if(header.empty()) co_return; // closed
+       conn->write(reply.data(), reply.size());
+       co_await conn->drain();
+       co_await loop->sleep(tv);
+   }
+ */
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+#include "BaseConn.h"
+#include "EventLoop.h"
+
+//a detached coroutine, it starts at once and frees itself at the end
+class CoTask
+{
+public:
+    struct promise_type
+    {
+        CoTask get_return_object() { return CoTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+//wait until the input has datlen bytes and take them, empty if the conn closes
+class ConnReadAwaiter
+{
+public:
+    ConnReadAwaiter(const BaseConnPtr & conn, size_t datlen):conn_(conn), datlen_(datlen) {}
+
+    bool await_ready() { return ready(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        handle_ = handle;
+        conn_->setReadWaiter(Task(Resumer{this}));
+    }
+
+    std::vector<char> await_resume()
+    {
+        std::vector<char> data;
+        if(!conn_->closed() && datlen_ > 0)
+        {
+            data.resize(datlen_);
+            conn_->read(data.data(), datlen_);
+        }
+
+        return data;
+    }
+private:
+    struct Resumer
+    {
+        ConnReadAwaiter * awaiter_;
+
+        void operator()()
+        {
+            if(awaiter_->ready())
+            {
+                awaiter_->handle_.resume();
+            }
+            else
+            {
+                awaiter_->conn_->setReadWaiter(Task(Resumer{awaiter_}));
+            }
+        }
+    };
+
+    bool ready() { return conn_->closed() || conn_->readable() >= datlen_; }
+
+    BaseConnPtr conn_; // keep the conn alive while waiting
+    size_t datlen_;
+    std::coroutine_handle<> handle_;
+};
+
+//wait until the output falls to lowWatermark, resume at once if the conn closes
+class ConnDrainAwaiter
+{
+public:
+    ConnDrainAwaiter(const BaseConnPtr & conn, size_t lowWatermark):conn_(conn), lowWatermark_(lowWatermark) {}
+
+    bool await_ready() { return ready(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        handle_ = handle;
+        conn_->setDrainWaiter(lowWatermark_, Task(Resumer{this}));
+    }
+
+    //false if the conn is closed
+    bool await_resume() { return !conn_->closed(); }
+private:
+    struct Resumer
+    {
+        ConnDrainAwaiter * awaiter_;
+
+        void operator()()
+        {
+            if(awaiter_->ready())
+            {
+                awaiter_->handle_.resume();
+            }
+            else
+            {
+                awaiter_->conn_->setDrainWaiter(awaiter_->lowWatermark_, Task(Resumer{awaiter_}));
+            }
+        }
+    };
+
+    bool ready() { return conn_->closed() || conn_->outputLength() <= lowWatermark_; }
+
+    BaseConnPtr conn_;
+    size_t lowWatermark_;
+    std::coroutine_handle<> handle_;
+};
+
+//resume in the loop thread after tv
+class LoopSleepAwaiter
+{
+public:
+    LoopSleepAwaiter(EventLoop * loop, const struct timeval & tv):loop_(loop), tv_(tv) {}
+
+    bool await_ready() { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        loop_->runAfter(tv_, Task([handle]{ handle.resume(); }));
+    }
+
+    void await_resume() {}
+private:
+    EventLoop * loop_;
+    struct timeval tv_;
+};
+
+inline ConnReadAwaiter BaseConn::readExactly(size_t datlen)
+{
+    return ConnReadAwaiter(shared_from_this(), datlen);
+}
+
+inline ConnDrainAwaiter BaseConn::drain(size_t lowWatermark)
+{
+    return ConnDrainAwaiter(shared_from_this(), lowWatermark);
+}
+
+inline LoopSleepAwaiter EventLoop::sleep(const struct timeval & tv)
+{
+    return LoopSleepAwaiter(this, tv);
+}
+
+#endif
+
+#endif // _COROUTINE_H_
@@ -0,0 +1,180 @@
+#include "CpuOps.h"
+
+#include <sched.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <set>
+#include <utility>
+
+#include "StringOps.h"
+
+#define SYS_CPU_PATH "/sys/devices/system/cpu/"
+#define SYS_NODE_PATH "/sys/devices/system/node/"
+#define SYS_NET_PATH "/sys/class/net/"
+
+//set_mempolicy mode, an empty node mask with MPOL_PREFERRED is local allocation
+#define BASE_MPOL_PREFERRED 1
+
+static std::string readLine(const std::string & path)
+{
+    std::string line;
+    FILE * fp = fopen(path.c_str(), "r");
+    if(fp)
+    {
+        char szLine[4096] = {0};
+        if(fgets(szLine, sizeof(szLine), fp))
+        {
+            line = szLine;
+        }
+        fclose(fp);
+    }
+
+    while(!line.empty() && (line.back() == '\n' || line.back() == ' '))
+    {
+        line.pop_back();
+    }
+
+    return line;
+}
+
+//"0-3,8,10-11" -> 0 1 2 3 8 10 11
+void base::parseCpuList(const std::string & cpuList, std::vector<int> & cpus)
+{
+    std::vector<std::string> ranges;
+    base::splitex(cpuList, ",", ranges);
+    for(size_t i = 0; i < ranges.size(); ++i)
+    {
+        if(ranges[i].empty())
+        {
+            continue;
+        }
+
+        int first = atoi(ranges[i].c_str());
+        int last = first;
+        size_t pos = ranges[i].find('-');
+        if(pos != std::string::npos)
+        {
+            last = atoi(ranges[i].c_str() + pos + 1);
+        }
+
+        for(int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+}
+
+void base::getOnlineCpus(std::vector<int> & cpus)
+{
+    parseCpuList(readLine(SYS_CPU_PATH "online"), cpus);
+    if(cpus.empty())
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for(long i = 0; i < n; ++i)
+        {
+            cpus.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+//the first hyper thread of every physical core
+void base::getPhysicalCores(std::vector<int> & cpus)
+{
+    std::vector<int> online;
+    getOnlineCpus(online);
+
+    std::set<std::pair<int, int> > cores;
+    for(size_t i = 0; i < online.size(); ++i)
+    {
+        std::string topo = SYS_CPU_PATH "cpu" + base::toString(online[i]) + "/topology/";
+        std::string package = readLine(topo + "physical_package_id");
+        std::string core = readLine(topo + "core_id");
+        if(package.empty() || core.empty())
+        {
+            cpus.push_back(online[i]);
+            continue;
+        }
+
+        if(cores.insert(std::make_pair(atoi(package.c_str()), atoi(core.c_str()))).second)
+        {
+            cpus.push_back(online[i]);
+        }
+    }
+}
+
+void base::getNodeCpus(int node, std::vector<int> & cpus)
+{
+    parseCpuList(readLine(SYS_NODE_PATH "node" + base::toString(node) + "/cpulist"), cpus);
+}
+
+//-1 if the nic is not on a numa node(or the machine is not numa)
+int base::getNicNode(const std::string & nic)
+{
+    std::string node = readLine(SYS_NET_PATH + nic + "/device/numa_node");
+    return node.empty() ? -1 : atoi(node.c_str());
+}
+
+int base::getCpuNode(int cpu)
+{
+    std::string cpuPath = SYS_CPU_PATH "cpu" + base::toString(cpu) + "/";
+    DIR * dir = opendir(cpuPath.c_str());
+    if(!dir)
+    {
+        return -1;
+    }
+
+    int node = -1;
+    struct dirent * entry = nullptr;
+    while((entry = readdir(dir)) != nullptr)
+    {
+        if(strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+
+    closedir(dir);
+    return node;
+}
+
+bool base::bindCpu(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+}
+
+//allocate the memory of the calling thread from the node it runs on
+bool base::bindLocalMemory()
+{
+    return ::syscall(SYS_set_mempolicy, BASE_MPOL_PREFERRED, nullptr, 0) == 0;
+}
+
+//the cpu the calling thread is bound to, -1 if it can run on several
+int base::getBoundCpu()
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if(pthread_getaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0 || CPU_COUNT(&cpuset) != 1)
+    {
+        return -1;
+    }
+
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if(CPU_ISSET(cpu, &cpuset))
+        {
+            return cpu;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,21 @@
+#ifndef _CPU_OPS_H_
+#define _CPU_OPS_H_
+
+#include <string>
+#include <vector>
+
+namespace base
+{
+void parseCpuList(const std::string & cpuList, std::vector<int> & cpus);
+void getOnlineCpus(std::vector<int> & cpus);
+void getPhysicalCores(std::vector<int> & cpus);
+void getNodeCpus(int node, std::vector<int> & cpus);
+int getNicNode(const std::string & nic);
+int getCpuNode(int cpu);
+
+bool bindCpu(int cpu);
+bool bindLocalMemory();
+int getBoundCpu();
+}
+
+#endif // _CPU_OPS_H_
@@ -10,17 +10,35 @@
 #include "BaseConn.h"
 #include "WeakCallback.h"
 
-EventLoop::EventLoop(int loopId):
+//the loop created in this thread
+static __thread EventLoop * t_loopInThisThread = nullptr;
+
+EventLoop::EventLoop(int loopId, int timerBackend):
     loopId_(loopId),
     threadId_(CurrentThread::tid()),
     wakeupEvent_(nullptr),
     wakeupFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
     base_(nullptr),
     quit_(false),
-    sizePendingFunctors_(0)
+    sizePendingFunctors_(0),
+    outstandingFunctors_(0),
+    connCount_(0),
+    busyTime_(0),
+    iterBusyTime_(0),
+    callbackEnter_(0),
+    callbackBegin_(0),
+    callbackName_(nullptr),
+    callbackWhat_(nullptr),
+    callbackFile_(nullptr),
+    callbackLine_(0)
 {
     ASSERT_ABORT(wakeupFd_ > 0);
 
+    if(!t_loopInThisThread)
+    {
+        t_loopInThisThread = this;
+    }
+
     base_ = event_base_new();
     ASSERT_ABORT(base_);
 
@@ -28,10 +46,25 @@ EventLoop::EventLoop(int loopId):
     wakeupEvent_= event_new(base_, wakeupFd_, EV_READ| EV_PERSIST, handleWakeup, this);
     ASSERT_ABORT(wakeupEvent_);
     ASSERT_ABORT(event_add(wakeupEvent_, nullptr) == 0);
+
+    if(timerBackend == TIMER_BACKEND_WHEEL)
+    {
+        timerWheel_.reset(new TimerWheel(this));
+    }
+
+    MetricsRegistry::instance().addLoop(this);
 }
 
 EventLoop::~EventLoop()
 {
+    MetricsRegistry::instance().delLoop(this);
+
+    if(t_loopInThisThread == this)
+    {
+        t_loopInThisThread = nullptr;
+    }
+
+    timerWheel_.reset();
     event_base_free(base_);
     event_free(wakeupEvent_);
     ::close(wakeupFd_);
@@ -43,23 +76,44 @@ EventLoop::~EventLoop()
     }
 }
 
+EventLoop * EventLoop::getCurrentLoop()
+{
+    return t_loopInThisThread;
+}
+
 void EventLoop::loop()
 {
     assert(base_ != nullptr);
 
+    int64_t iterBegin = TimeStamp::now().microseconds();
     while(!quit_)
     {
         event_base_loop(base_, EVLOOP_ONCE);
+
         doPendingFunctors();
+        int64_t end = TimeStamp::now().microseconds();
+
+        //the time outside the callbacks is polling, or libevent itself
+        int64_t pollTime = end - iterBegin - iterBusyTime_;
+        statAdd(stats_.iterations_, 1);
+        statAdd(stats_.callbackTime_, static_cast<uint64_t>(iterBusyTime_));
+        statAdd(stats_.pollTime_, static_cast<uint64_t>(MAX_VALUE(pollTime, 0)));
+        iterBegin = end;
+
+        busyTime_.store((busyTime_.load(std::memory_order_relaxed)*7 + iterBusyTime_)/8, std::memory_order_relaxed);
+        iterBusyTime_ = 0;
     }
 
-    LOG_INFO("loop quited %p, pendingFunctors_=%d", this, sizePendingFunctors_);
+    LOG_INFO("loop quited %p, pendingFunctors_=%d", this, sizePendingFunctors_.load());
 
     quit_ = false;
 
-    std::unique_lock<std::mutex> lock(mutex_);
     sizePendingFunctors_ = 0;
-    pendingFunctors_.clear();
+    PendingFunctor functor;
+    while(pendingFunctors_.pop(functor))
+    {
+        outstandingFunctors_.fetch_sub(1, std::memory_order_relaxed);
+    }
 }
 
 //not thread safe, please close eventloop in the loop thread
@@ -71,7 +125,7 @@ void EventLoop::quit()
 }
 
 //if in loop thread this call immediately, else queue in loop
-void EventLoop::runInLoop(const Functor && cb)
+void EventLoop::runInLoop(Functor && cb, const char * file, int line)
 {
     if(isInLoopThread())
     {
@@ -79,39 +133,51 @@ void EventLoop::runInLoop(const Functor && cb)
     }
     else
     {
-        queueInLoop(std::move(cb));
+        queueInLoop(std::move(cb), file, line);
     }
 }
 
 //called when the loop event end
-void EventLoop::queueInLoop(const Functor && cb)
+//lock free: push first, then count, only the empty to nonempty producer wakes up
+void EventLoop::queueInLoop(Functor && cb, const char * file, int line)
 {
-    size_t sizePendingFunctors = 0;
-
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        sizePendingFunctors = sizePendingFunctors_++;
-        pendingFunctors_.emplace_back(std::move(cb));
-    }
+    outstandingFunctors_.fetch_add(1, std::memory_order_relaxed);
+    pendingFunctors_.push(PendingFunctor(std::move(cb), TimeStamp::now().microseconds(), file, line));
 
-    if(sizePendingFunctors == 0)
+    if(sizePendingFunctors_.fetch_add(1, std::memory_order_acq_rel) == 0)
     {
         wakeup();
     }
 }
 
-TimerId EventLoop::runAfter(const struct timeval & tv, const Functor && cb)
+TimerId EventLoop::runAfter(const struct timeval & tv, Functor && cb)
 {
+    if(timerWheel_)
+    {
+        return timerWheel_->createTimer(tv, std::move(cb), TIMER_ONCE);
+    }
+
     return TimerObj::createTimer(this, tv, std::move(cb), TIMER_ONCE);
 }
 
-TimerId  EventLoop::runEvery(const struct timeval & tv, const Functor && cb)
+TimerId  EventLoop::runEvery(const struct timeval & tv, Functor && cb)
 {
+    if(timerWheel_)
+    {
+        return timerWheel_->createTimer(tv, std::move(cb), TIMER_PERSIST);
+    }
+
     return TimerObj::createTimer(this, tv, std::move(cb), TIMER_PERSIST);
 }
 
 void EventLoop::cancel(TimerId timer)
 {
+    if(timerWheel_)
+    {
+        timerWheel_->deleteTimer(timer);
+        return;
+    }
+
     TimerObj::deleteTimer(this, timer);
 }
 
@@ -125,19 +191,74 @@ void EventLoop::addSignal(int x, signal_callback_fn cb, void * arg)
 
 void EventLoop::doPendingFunctors()
 {
-    FunctorList functors;
+    //only run the functors counted before the exchange, a functor queued
+    //after it sees zero and wakes the loop up again
+    size_t sizePendingFunctors = sizePendingFunctors_.exchange(0, std::memory_order_acq_rel);
+    statMax(stats_.maxPending_, sizePendingFunctors);
+    if(sizePendingFunctors == 0)
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        sizePendingFunctors_ = 0;
-        functors.swap(pendingFunctors_);
+        return;
     }
 
-    for(FunctorList::iterator it = functors.begin(); it != functors.end(); ++it)
+    //the end of a functor is the begin of the next one
+    int64_t now = TimeStamp::now().microseconds();
+    size_t run = 0;
+    bool again = pendingFunctors_.popCounted(sizePendingFunctors_, sizePendingFunctors, [this, &now, &run](PendingFunctor & functor) {
+        stats_.queueLatency_.record(now - functor.queueTime_);
+        enterCallback(now, functor.cb_.name(), "functor", functor.file_, functor.line_);
+        functor.cb_();
+        now = TimeStamp::now().microseconds();
+        leaveCallback(now);
+        outstandingFunctors_.fetch_sub(1, std::memory_order_relaxed);
+        ++run;
+    });
+    statAdd(stats_.functors_, run);
+
+    //the functors behind a half done push run in the next pass, a few
+    //instructions away unless that producer was preempted
+    if(again)
     {
-        (*it)();
+        wakeup();
     }
 }
 
+void EventLoop::enterCallback(int64_t now, const char * name, const char * what, const char * file, int line)
+{
+    callbackEnter_ = now;
+    callbackName_.store(name, std::memory_order_relaxed);
+    callbackWhat_.store(what, std::memory_order_relaxed);
+    callbackFile_.store(file, std::memory_order_relaxed);
+    callbackLine_.store(line, std::memory_order_relaxed);
+    callbackBegin_.store(now, std::memory_order_release);
+}
+
+void EventLoop::leaveCallback(int64_t now)
+{
+    callbackBegin_.store(0, std::memory_order_relaxed);
+
+    int64_t us = now - callbackEnter_;
+    iterBusyTime_ += us;
+    stats_.callbackLatency_.record(us);
+}
+
+//the fields are stable while begin doesn't change, a racing read is dropped
+bool EventLoop::getCallback(int64_t & begin, const char *& name, const char *& what, const char *& file, int & line) const
+{
+    begin = callbackBegin_.load(std::memory_order_acquire);
+    if(begin == 0)
+    {
+        return false;
+    }
+
+    name = callbackName_.load(std::memory_order_relaxed);
+    what = callbackWhat_.load(std::memory_order_relaxed);
+    file = callbackFile_.load(std::memory_order_relaxed);
+    line = callbackLine_.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return callbackBegin_.load(std::memory_order_relaxed) == begin;
+}
+
 void EventLoop::addTimer(TimerId timerId, std::unique_ptr<TimerObj> & timerObj)
 {
     timerMap_.insert(std::make_pair(timerId, std::move(timerObj)));
@@ -5,26 +5,58 @@
 #include <map>
 #include <memory>
 #include <thread>
-#include <mutex>
+#include <atomic>
 
 #include "CurrentThread.h"
 #include "TimerId.h"
+#include "TimerWheel.h"
+#include "MpscQueue.h"
+#include "TimeStamp.h"
+#include "Task.h"
+#include "Metrics.h"
+
+class BaseConn;
+class LoopSleepAwaiter;
 
 class EventLoop
 {
 public:
-    typedef std::function<void()> Functor;
-    typedef std::vector<Functor> FunctorList;
+    typedef Task Functor;
+
+    //a queued functor, with the time and the place it was queued
+    struct PendingFunctor
+    {
+        PendingFunctor():queueTime_(0), file_(nullptr), line_(0) {}
+        PendingFunctor(Functor && cb, int64_t queueTime, const char * file, int line):
+            cb_(std::move(cb)), queueTime_(queueTime), file_(file), line_(line)
+        {}
+
+        Functor cb_;
+        int64_t queueTime_;
+        const char * file_;
+        int line_;
+    };
+
+    typedef MpscQueue<PendingFunctor> FunctorQueue;
     typedef std::map<TimerId, std::unique_ptr<TimerObj> > TimerMap;
     typedef void (*signal_callback_fn)(int, short, void *);
 
-    EventLoop(int loopId = 0);
+    EventLoop(int loopId = 0, int timerBackend = TIMER_BACKEND_EVENT);
     ~EventLoop();
 
     void loop();
     void quit();
 
     struct event_base * get_event() { return base_; }
+    static EventLoop * getCurrentLoop(); // the loop of the calling thread, or null
+    int loopId() const { return loopId_; }
+
+    //the load counters, they can be read from any thread
+    int connCount() const { return connCount_.load(std::memory_order_relaxed); }
+    size_t pendingCount() const { return outstandingFunctors_.load(std::memory_order_relaxed); }
+    int64_t busyTime() const { return busyTime_.load(std::memory_order_relaxed); }
+    const LoopStats & stats() const { return stats_; }
+    int threadId() const { return threadId_; }
 
     inline bool isInLoopThread() const
     {
@@ -39,15 +71,33 @@ public:
         }
     }
 
-    void runInLoop(const Functor && cb);
-    void queueInLoop(const Functor && cb);
+    //file and line default to the caller, the watchdog reports them on a stall
+    void runInLoop(Functor && cb, const char * file = __builtin_FILE(), int line = __builtin_LINE());
+    void queueInLoop(Functor && cb, const char * file = __builtin_FILE(), int line = __builtin_LINE());
 
-    TimerId runAfter(const struct timeval & tv, const Functor && cb);
-    TimerId runEvery(const struct timeval & tv, const Functor && cb);
+    TimerId runAfter(const struct timeval & tv, Functor && cb);
+    TimerId runEvery(const struct timeval & tv, Functor && cb);
     void cancel(TimerId timer);
 
+    //C++20 coroutines, include Coroutine.h to use it
+    LoopSleepAwaiter sleep(const struct timeval & tv);
+
     void addSignal(int x, signal_callback_fn cb, void * arg);
+
+    /*
+      the callback running now, for the watchdog, false if the loop is idle
+
+      @param begin the microseconds it began at
+      @param name the mangled type of the callable or the conn
+      @param what the kind of callback, "functor", "timer", "onRead"...
+      @param file/line where a functor was queued, null/0 for the others
+    */
+    bool getCallback(int64_t & begin, const char *& name, const char *& what, const char *& file, int & line) const;
 private:
+    //time a callback and publish it to the watchdog
+    void enterCallback(int64_t now, const char * name, const char * what, const char * file = nullptr, int line = 0);
+    void leaveCallback(int64_t now);
+
     void doPendingFunctors();
 
     void addTimer(TimerId timerId, std::unique_ptr<TimerObj> & timerObj);
@@ -67,14 +117,31 @@ private:
     struct event_base * base_;
     bool quit_;
 
-    std::mutex mutex_;
-    FunctorList pendingFunctors_;
-    size_t sizePendingFunctors_;
+    FunctorQueue pendingFunctors_;
+    std::atomic<size_t> sizePendingFunctors_; // the wakeup protocol, zeroed by each drain
+    std::atomic<size_t> outstandingFunctors_; // queued and not run yet, for the load
+
+    std::atomic<int> connCount_; // the connected BaseConn on this loop
+    std::atomic<int64_t> busyTime_; // the busy microseconds per iteration, moving average
+    int64_t iterBusyTime_; // the busy microseconds of this iteration
+    LoopStats stats_;
+
+    //the callback running now, written by the loop, read by the watchdog
+    int64_t callbackEnter_;
+    std::atomic<int64_t> callbackBegin_; // 0 if no callback runs
+    std::atomic<const char *> callbackName_;
+    std::atomic<const char *> callbackWhat_;
+    std::atomic<const char *> callbackFile_;
+    std::atomic<int> callbackLine_;
 
     TimerMap    timerMap_;
+    std::unique_ptr<TimerWheel> timerWheel_; // null unless TIMER_BACKEND_WHEEL
 
     std::vector<struct event *> signalEvents_;
     friend TimerObj;
+    friend TimerWheel;
+    friend BaseConn;
+    friend class LoopWatchdog;
 };
 
 
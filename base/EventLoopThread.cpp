@@ -2,9 +2,15 @@
 
 #include <assert.h>
 #include "EventLoop.h"
+#include "CpuOps.h"
+#include "BaseUtil.h"
 
-EventLoopThread::EventLoopThread(int loopId):
+EventLoopThread::EventLoopThread(int loopId, int timerBackend, int cpu):
     loopId_(loopId),
+    timerBackend_(timerBackend),
+    cpu_(cpu),
+    boundCpu_(-1),
+    numaNode_(-1),
     loop_(nullptr)
 {
 
@@ -68,9 +74,25 @@ EventLoop * EventLoopThread::getLoop()
 
 void EventLoopThread::threadFunc()
 {
+    //pin before the loop is created, so its memory comes from the local node
+    if(cpu_ >= 0)
+    {
+        if(base::bindCpu(cpu_))
+        {
+            base::bindLocalMemory();
+        }
+        else
+        {
+            LOG_WARN("bind loop=%d to cpu=%d failed", loopId_, cpu_);
+        }
+    }
+
+    boundCpu_ = base::getBoundCpu();
+    numaNode_ = boundCpu_ >= 0 ? base::getCpuNode(boundCpu_) : -1;
+
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        loop_.reset(new EventLoop(loopId_));
+        loop_.reset(new EventLoop(loopId_, timerBackend_));
         cond_.notify_all();
     }
 
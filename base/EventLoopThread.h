@@ -5,22 +5,33 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "TimerId.h"
+
 class EventLoop;
 
 class EventLoopThread
 {
 public:
-    EventLoopThread(int loopId = 0);
+    //cpu >= 0 pins the loop thread and its memory allocations to that cpu's node
+    EventLoopThread(int loopId = 0, int timerBackend = TIMER_BACKEND_EVENT, int cpu = -1);
     ~EventLoopThread();
 public:
     EventLoop * startLoop();
     EventLoop * getLoop();
     void stopLoop();
+
+    //the effective placement, -1 if the thread is not pinned
+    int cpu() const { return boundCpu_; }
+    int numaNode() const { return numaNode_; }
 private:
     void threadFunc();
 
 private:
     int         loopId_;
+    int         timerBackend_;
+    int         cpu_; // the requested cpu
+    int         boundCpu_; // the cpu the thread is bound to
+    int         numaNode_;
     std::unique_ptr<EventLoop> loop_;
 
     std::thread thread_;
@@ -1,13 +1,17 @@
 #include "EventLoopThreadPool.h"
 
 #include <assert.h>
+#include <algorithm>
 
 #include "EventLoop.h"
 #include "EventLoopThread.h"
+#include "CpuOps.h"
+#include "BaseUtil.h"
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop * baseLoop):
     baseLoop_(baseLoop),
-    next_(0)
+    next_(0),
+    policy_(LOOP_ROUND_ROBIN)
 {
 }
 
@@ -15,16 +19,31 @@ EventLoopThreadPool::~EventLoopThreadPool()
 {
 }
 
-void EventLoopThreadPool::start(int numThreads)
+void EventLoopThreadPool::start(int numThreads, int timerBackend)
+{
+    start(numThreads, LoopPlacement(), timerBackend);
+}
+
+void EventLoopThreadPool::start(int numThreads, const LoopPlacement & placement, int timerBackend)
 {
     baseLoop_->assertInLoopThread();
+
+    std::vector<int> cpus;
+    resolvePlacement(placement, cpus);
+
+    //a second start() adds loops, their ids go on from the first ones, the
+    //ring points come from the ids and must not repeat
+    int firstId = static_cast<int>(threads_.size());
     for(int i = 0; i < numThreads; ++i)
     {
-        EventLoopThreadPtr elt(MakeEventLoopThreadPtr(i));
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        EventLoopThreadPtr elt(MakeEventLoopThreadPtr(firstId + i, timerBackend, cpu));
         elt->startLoop();
 
         threads_.emplace_back(elt);
     }
+
+    buildRing();
 }
 
 void EventLoopThreadPool::quit()
@@ -42,12 +61,34 @@ EventLoop * EventLoopThreadPool::getNextLoop()
     EventLoop * loop = baseLoop_;
     if(!threads_.empty())
     {
-        if(next_ >= threads_.size())
+        if(policy_ & LOOP_LEAST_LOADED)
         {
-            next_ = 0;
+            //start from next_ so the ties are still spread round robin
+            size_t best = next_ % threads_.size();
+            int64_t bestScore = loadScore(threads_[best]->getLoop());
+            for(size_t i = 1; i < threads_.size(); ++i)
+            {
+                size_t idx = (next_ + i) % threads_.size();
+                int64_t score = loadScore(threads_[idx]->getLoop());
+                if(score < bestScore)
+                {
+                    best = idx;
+                    bestScore = score;
+                }
+            }
+
+            next_ = best + 1;
+            loop = threads_[best]->getLoop();
         }
+        else
+        {
+            if(next_ >= threads_.size())
+            {
+                next_ = 0;
+            }
 
-        loop = threads_[next_++]->getLoop();
+            loop = threads_[next_++]->getLoop();
+        }
     }
 
     assert(loop != nullptr);
@@ -60,6 +101,11 @@ EventLoop * EventLoopThreadPool::getModLoop(int sessionId)
     EventLoop * loop = baseLoop_;
     if(!threads_.empty())
     {
+        if(policy_ & LOOP_CONSISTENT_HASH)
+        {
+            return getHashLoop(static_cast<uint32_t>(sessionId));
+        }
+
         sessionId %= threads_.size();
 
         loop = threads_[sessionId]->getLoop();
@@ -67,3 +113,115 @@ EventLoop * EventLoopThreadPool::getModLoop(int sessionId)
 
     return loop;
 }
+
+//the same key keeps its loop when the pool is resized, except ~1/size of them
+EventLoop * EventLoopThreadPool::getHashLoop(uint64_t key)
+{
+    if(ring_.empty())
+    {
+        return baseLoop_;
+    }
+
+    uint64_t point = hash(key);
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(point, static_cast<size_t>(0)));
+    if(it == ring_.end())
+    {
+        it = ring_.begin();
+    }
+
+    return threads_[it->second]->getLoop();
+}
+
+//one connection weighs as much as one pending functor or 100us busy per iteration
+int64_t EventLoopThreadPool::loadScore(const EventLoop * loop)
+{
+    return static_cast<int64_t>(loop->connCount())
+            + static_cast<int64_t>(loop->pendingCount())
+            + loop->busyTime()/100;
+}
+
+//splitmix64 finalizer
+uint64_t EventLoopThreadPool::hash(uint64_t key)
+{
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+//built again from all the loops, the old points are dropped first
+void EventLoopThreadPool::buildRing()
+{
+    ring_.clear();
+    for(size_t i = 0; i < threads_.size(); ++i)
+    {
+        //the points depend on the loop id only, not on the pool size
+        uint64_t loopId = static_cast<uint64_t>(threads_[i]->getLoop()->loopId());
+        for(uint64_t v = 0; v < LOOP_VIRTUAL_NODES; ++v)
+        {
+            ring_.push_back(std::make_pair(hash((loopId << 32) | v), i));
+        }
+    }
+
+    std::sort(ring_.begin(), ring_.end());
+}
+
+std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
+{
+    std::vector<EventLoop *> loops;
+    for(size_t i = 0; i < threads_.size(); ++i)
+    {
+        loops.push_back(threads_[i]->getLoop());
+    }
+
+    return loops;
+}
+
+void EventLoopThreadPool::getPlacement(std::vector<int> & cpus, std::vector<int> & nodes)
+{
+    for(size_t i = 0; i < threads_.size(); ++i)
+    {
+        cpus.push_back(threads_[i]->cpu());
+        nodes.push_back(threads_[i]->numaNode());
+    }
+}
+
+void EventLoopThreadPool::resolvePlacement(const LoopPlacement & placement, std::vector<int> & cpus)
+{
+    if(placement.type_ == PLACE_CPU_LIST)
+    {
+        cpus = placement.cpus_;
+    }
+    else if(placement.type_ == PLACE_PHYSICAL_CORE)
+    {
+        base::getPhysicalCores(cpus);
+    }
+    else if(placement.type_ == PLACE_NIC_NODE)
+    {
+        std::vector<int> cores;
+        base::getPhysicalCores(cores);
+
+        int node = base::getNicNode(placement.nic_);
+        if(node < 0)
+        {
+            LOG_WARN("nic=%s has no numa node, use all the physical cores", placement.nic_.c_str());
+            cpus.swap(cores);
+            return;
+        }
+
+        std::vector<int> nodeCpus;
+        base::getNodeCpus(node, nodeCpus);
+        for(size_t i = 0; i < cores.size(); ++i)
+        {
+            if(std::find(nodeCpus.begin(), nodeCpus.end(), cores[i]) != nodeCpus.end())
+            {
+                cpus.push_back(cores[i]);
+            }
+        }
+
+        if(cpus.empty())
+        {
+            cpus.swap(nodeCpus);
+        }
+    }
+}
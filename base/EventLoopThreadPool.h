@@ -1,8 +1,13 @@
 #ifndef _EVENT_LOOP_THREAD_POOL_
 #define _EVENT_LOOP_THREAD_POOL_
 
+#include <stdint.h>
 #include <vector>
 #include <memory>
+#include <utility>
+#include <string>
+
+#include "TimerId.h"
 
 class BaseConn;
 class EventLoop;
@@ -11,20 +16,65 @@ class EventLoopThread;
 typedef std::shared_ptr<EventLoopThread> EventLoopThreadPtr;
 #define MakeEventLoopThreadPtr std::make_shared<EventLoopThread>
 
+enum
+{
+    LOOP_ROUND_ROBIN = 0, // getNextLoop: round robin, getModLoop: sessionId % size
+    LOOP_LEAST_LOADED = 1, // getNextLoop: the loop with the least load score
+    LOOP_CONSISTENT_HASH = 2 // getModLoop: consistent hash ring with virtual nodes
+};
+
+#define LOOP_VIRTUAL_NODES 160
+
+enum
+{
+    PLACE_NONE = 0, // let the scheduler migrate the loop threads
+    PLACE_CPU_LIST, // pin the threads to cpus_ in turn
+    PLACE_PHYSICAL_CORE, // one thread per physical core, no hyper thread siblings
+    PLACE_NIC_NODE // the physical cores of the numa node of nic_
+};
+
+struct LoopPlacement
+{
+    LoopPlacement(int type = PLACE_NONE):type_(type) {}
+
+    int type_;
+    std::vector<int> cpus_;
+    std::string nic_;
+};
+
 class EventLoopThreadPool
 {
 public:
     EventLoopThreadPool(EventLoop * baseLoop);
     ~EventLoopThreadPool();
 public:
-    void start(int numThreads);
+    void start(int numThreads, int timerBackend = TIMER_BACKEND_EVENT);
+    void start(int numThreads, const LoopPlacement & placement, int timerBackend = TIMER_BACKEND_EVENT);
     void quit();
 
+    //set before start(), the policy can combine LOOP_LEAST_LOADED|LOOP_CONSISTENT_HASH
+    void setPolicy(int policy) { policy_ = policy; }
+    int policy() const { return policy_; }
+
     EventLoop * getNextLoop();
     EventLoop * getModLoop(int sessionId);
+    EventLoop * getHashLoop(uint64_t key);
+    std::vector<EventLoop *> getAllLoops();
+
+    //the effective cpu and numa node of every loop thread, -1 if not pinned
+    void getPlacement(std::vector<int> & cpus, std::vector<int> & nodes);
+private:
+    static int64_t loadScore(const EventLoop * loop);
+    static uint64_t hash(uint64_t key);
+    void buildRing();
+    static void resolvePlacement(const LoopPlacement & placement, std::vector<int> & cpus);
+
 private:
     EventLoop * baseLoop_;
     size_t next_;
+    int policy_;
+
+    std::vector<std::pair<uint64_t, size_t> > ring_; // the hash ring, point -> thread index
 
     std::vector<EventLoopThreadPtr> threads_;
 
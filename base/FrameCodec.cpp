@@ -0,0 +1,115 @@
+#include "FrameCodec.h"
+
+FrameCodec::FrameCodec(int type, size_t lengthBytes, size_t maxFrameSize, bool includeHeader):
+    type_(type),
+    lengthBytes_(lengthBytes),
+    maxFrameSize_(maxFrameSize),
+    includeHeader_(includeHeader)
+{
+    if(lengthBytes_ != 1 && lengthBytes_ != 2 && lengthBytes_ != 4 && lengthBytes_ != 8)
+    {
+        lengthBytes_ = 4;
+    }
+}
+
+int FrameCodec::decode(const char * data, size_t len, size_t & headerLen, size_t & frameLen) const
+{
+    const unsigned char * p = reinterpret_cast<const unsigned char *>(data);
+    uint64_t length = 0;
+
+    if(type_ == LENGTH_VARINT)
+    {
+        size_t i = 0;
+        for(; i < len && i < MaxHeaderSize; ++i)
+        {
+            length |= static_cast<uint64_t>(p[i] & 0x7f) << (7*i);
+            if((p[i] & 0x80) == 0)
+            {
+                break;
+            }
+        }
+
+        if(i == MaxHeaderSize)
+        {
+            return DECODE_ERROR;
+        }
+
+        if(i == len)
+        {
+            return DECODE_MORE;
+        }
+
+        headerLen = i + 1;
+    }
+    else
+    {
+        if(len < lengthBytes_)
+        {
+            return DECODE_MORE;
+        }
+
+        for(size_t i = 0; i < lengthBytes_; ++i)
+        {
+            length = (length << 8) | p[i];
+        }
+
+        headerLen = lengthBytes_;
+    }
+
+    if(includeHeader_)
+    {
+        if(length < headerLen || length > maxFrameSize_)
+        {
+            return DECODE_ERROR;
+        }
+    }
+    else
+    {
+        //a hostile length near 2^64 would wrap
+        if(!fits(headerLen, length))
+        {
+            return DECODE_ERROR;
+        }
+        length += headerLen;
+    }
+
+    frameLen = static_cast<size_t>(length);
+    return DECODE_FRAME;
+}
+
+size_t FrameCodec::encode(char * out, size_t bodyLen) const
+{
+    unsigned char * p = reinterpret_cast<unsigned char *>(out);
+
+    if(type_ == LENGTH_VARINT)
+    {
+        uint64_t length = bodyLen;
+        if(includeHeader_)
+        {
+            //the prefix size depends on the value it encodes
+            size_t n = 1;
+            while((length + n) >> (7*n))
+            {
+                ++n;
+            }
+            length += n;
+        }
+
+        size_t i = 0;
+        while(length >= 0x80)
+        {
+            p[i++] = static_cast<unsigned char>(length | 0x80);
+            length >>= 7;
+        }
+        p[i++] = static_cast<unsigned char>(length);
+        return i;
+    }
+
+    uint64_t length = includeHeader_ ? bodyLen + lengthBytes_ : bodyLen;
+    for(size_t i = 0; i < lengthBytes_; ++i)
+    {
+        p[lengthBytes_ - 1 - i] = static_cast<unsigned char>(length >> (8*i));
+    }
+
+    return lengthBytes_;
+}
@@ -0,0 +1,93 @@
+#ifndef _FRAME_CODEC_H_
+#define _FRAME_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEF_MAX_FRAME_SIZE 16*1024*1024
+
+/*
+   FrameView: a complete frame in the connection input, valid only during
+   BaseConn::onMessage, data() points to the length prefix
+ */
+class FrameView
+{
+public:
+    FrameView(const char * data, size_t size, size_t headerLen):
+        data_(data), size_(size), headerLen_(headerLen)
+    {}
+
+    const char * data() const { return data_; }
+    size_t size() const { return size_; }
+    const char * body() const { return data_ + headerLen_; }
+    size_t bodySize() const { return size_ - headerLen_; }
+    size_t headerLen() const { return headerLen_; }
+private:
+    const char * data_; // the frame with the length prefix
+    size_t size_; // the frame size
+    size_t headerLen_; // the length prefix size
+};
+
+/*
+   FrameCodec: length-prefixed framing
+
+   LENGTH_FIXED: a big endian length of 1/2/4/8 bytes
+   LENGTH_VARINT: a base-128 varint length(protobuf style)
+   includeHeader: the length counts the prefix itself, not only the body
+ */
+class FrameCodec
+{
+public:
+    enum
+    {
+        LENGTH_FIXED = 0,
+        LENGTH_VARINT
+    };
+
+    enum
+    {
+        DECODE_MORE = 0, // need more bytes
+        DECODE_FRAME, // a complete frame header
+        DECODE_ERROR // bad length or frame too large
+    };
+
+    static const size_t MaxHeaderSize = 10;
+
+    FrameCodec(int type = LENGTH_FIXED, size_t lengthBytes = 4, size_t maxFrameSize = DEF_MAX_FRAME_SIZE, bool includeHeader = false);
+
+    int type() const { return type_; }
+    size_t maxFrameSize() const { return maxFrameSize_; }
+
+    /*
+      decode the length prefix
+
+      @param data the first bytes of the input
+      @param len the size of data, at most MaxHeaderSize is needed
+      @param headerLen return the prefix size
+      @param frameLen return the whole frame size, prefix included
+      @return DECODE_MORE/DECODE_FRAME/DECODE_ERROR
+    */
+    int decode(const char * data, size_t len, size_t & headerLen, size_t & frameLen) const;
+
+    /*
+      encode the length prefix of a body
+
+      @param out at least MaxHeaderSize bytes
+      @return the prefix size
+    */
+    size_t encode(char * out, size_t bodyLen) const;
+
+    //whether a body of bodyLen after a prefix of headerLen is within maxFrameSize
+    bool fits(size_t headerLen, uint64_t bodyLen) const
+    {
+        return headerLen <= maxFrameSize_ && bodyLen <= maxFrameSize_ - headerLen;
+    }
+
+private:
+    int     type_;
+    size_t  lengthBytes_;
+    size_t  maxFrameSize_;
+    bool    includeHeader_;
+};
+
+#endif // _FRAME_CODEC_H_
@@ -0,0 +1,284 @@
+#ifndef _FUTURE_H_
+#define _FUTURE_H_
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <type_traits>
+
+#include "Task.h"
+#include "EventLoop.h"
+
+/*
+   Promise/Future: one shot result passing between threads
+
+   Future::then() registers a continuation, by default it runs on the
+   EventLoop of the thread calling then(), or inline on the thread that sets
+   the value if that thread has no loop; the continuations of a future run in
+   the order of the then() calls. A future without continuation can be polled
+   with ready()/value().
+
+   the continuations hold their state weakly: a promise dropped without a
+   value frees them, with the states waiting on it
+ */
+
+//the value of a Future made from a void function
+struct Unit {};
+
+template<typename T> class Promise;
+template<typename T> class Future;
+
+namespace FutureImpl
+{
+
+template<typename R>
+struct Result
+{
+    typedef R type;
+
+    template<typename F>
+    static R call(F & f) { return f(); }
+
+    template<typename F, typename T>
+    static R call(F & f, T & value) { return f(value); }
+};
+
+template<>
+struct Result<void>
+{
+    typedef Unit type;
+
+    template<typename F>
+    static Unit call(F & f) { f(); return Unit(); }
+
+    template<typename F, typename T>
+    static Unit call(F & f, T & value) { f(value); return Unit(); }
+};
+
+//two continuations of one state, in order
+struct ChainedTask
+{
+    Task first_;
+    Task second_;
+
+    void operator()()
+    {
+        first_();
+        second_();
+    }
+};
+
+template<typename T>
+class State
+{
+public:
+    State():ready_(false) {}
+
+    void setValue(T && value)
+    {
+        Task cb;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            value_ = std::move(value);
+            ready_ = true;
+            cb = std::move(cb_);
+        }
+
+        if(cb)
+        {
+            cb();
+        }
+    }
+
+    //run cb when the value is set, now if it already is
+    void onComplete(Task && cb)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(!ready_)
+            {
+                if(cb_)
+                {
+                    ChainedTask chained = { std::move(cb_), std::move(cb) };
+                    cb_ = std::move(chained);
+                }
+                else
+                {
+                    cb_ = std::move(cb);
+                }
+                return;
+            }
+        }
+
+        cb();
+    }
+
+    bool ready()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return ready_;
+    }
+
+    T & value() { return value_; }
+private:
+    std::mutex mutex_;
+    bool ready_;
+    T value_;
+    Task cb_; // the continuation
+};
+
+template<typename T, typename F, typename R>
+struct ThenRunner
+{
+    std::shared_ptr<State<T> > state_;
+    F f_;
+    Promise<typename Result<R>::type> promise_;
+
+    void operator()()
+    {
+        promise_.setValue(Result<R>::call(f_, state_->value()));
+    }
+};
+
+//kept by the state it waits on, so it holds that state weakly, the state is
+//alive while it sets the value and calls this
+template<typename T, typename F, typename R>
+struct ThenCallback
+{
+    EventLoop * loop_;
+    std::weak_ptr<State<T> > state_;
+    F f_;
+    Promise<typename Result<R>::type> promise_;
+
+    void operator()()
+    {
+        ThenRunner<T, F, R> runner = { state_.lock(), std::move(f_), std::move(promise_) };
+        if(loop_)
+        {
+            loop_->runInLoop(std::move(runner));
+        }
+        else
+        {
+            runner();
+        }
+    }
+};
+
+template<typename F, typename R>
+struct SubmitRunner
+{
+    F f_;
+    Promise<typename Result<R>::type> promise_;
+
+    void operator()()
+    {
+        promise_.setValue(Result<R>::call(f_));
+    }
+};
+
+template<typename T>
+struct WhenAll
+{
+    WhenAll(size_t size):left_(size), values_(size) {}
+
+    std::atomic<size_t> left_;
+    std::vector<T> values_;
+    Promise<std::vector<T> > promise_;
+};
+
+template<typename T>
+struct WhenAllCallback
+{
+    std::shared_ptr<WhenAll<T> > all_;
+    std::weak_ptr<State<T> > state_; // as ThenCallback
+    size_t index_;
+
+    void operator()()
+    {
+        all_->values_[index_] = std::move(state_.lock()->value());
+        if(all_->left_.fetch_sub(1) == 1)
+        {
+            all_->promise_.setValue(std::move(all_->values_));
+        }
+    }
+};
+
+}
+
+template<typename T>
+class Promise
+{
+public:
+    Promise():state_(std::make_shared<FutureImpl::State<T> >()) {}
+
+    Future<T> getFuture() { return Future<T>(state_); }
+
+    void setValue(T && value) { state_->setValue(std::move(value)); }
+    void setValue(const T & value) { state_->setValue(T(value)); }
+private:
+    std::shared_ptr<FutureImpl::State<T> > state_;
+};
+
+template<typename T>
+class Future
+{
+public:
+    Future() {}
+    explicit Future(const std::shared_ptr<FutureImpl::State<T> > & state):state_(state) {}
+
+    bool valid() const { return state_ != nullptr; }
+    bool ready() const { return state_->ready(); }
+    T & value() const { return state_->value(); }
+
+    //f(T &) runs on the loop of the calling thread
+    template<typename F>
+    auto then(F && f) -> Future<typename FutureImpl::Result<decltype(f(std::declval<T &>()))>::type>
+    {
+        return then(EventLoop::getCurrentLoop(), std::forward<F>(f));
+    }
+
+    //f(T &) runs on loop, or inline on the thread setting the value if loop is null
+    template<typename F>
+    auto then(EventLoop * loop, F && f) -> Future<typename FutureImpl::Result<decltype(f(std::declval<T &>()))>::type>
+    {
+        typedef typename std::decay<F>::type Fn;
+        typedef decltype(f(std::declval<T &>())) R;
+
+        FutureImpl::ThenCallback<T, Fn, R> cb = { loop, state_, std::forward<F>(f), Promise<typename FutureImpl::Result<R>::type>() };
+        auto future = cb.promise_.getFuture();
+        state_->onComplete(std::move(cb));
+        return future;
+    }
+
+private:
+    std::shared_ptr<FutureImpl::State<T> > state_;
+
+    template<typename U>
+    friend Future<std::vector<U> > when_all(const std::vector<Future<U> > & futures);
+};
+
+//complete when all the futures complete, the values keep the order of futures
+template<typename T>
+Future<std::vector<T> > when_all(const std::vector<Future<T> > & futures)
+{
+    std::shared_ptr<FutureImpl::WhenAll<T> > all = std::make_shared<FutureImpl::WhenAll<T> >(futures.size());
+    Future<std::vector<T> > future = all->promise_.getFuture();
+
+    if(futures.empty())
+    {
+        all->promise_.setValue(std::vector<T>());
+        return future;
+    }
+
+    for(size_t i = 0; i < futures.size(); ++i)
+    {
+        FutureImpl::WhenAllCallback<T> cb = { all, futures[i].state_, i };
+        futures[i].state_->onComplete(std::move(cb));
+    }
+
+    return future;
+}
+
+#endif // _FUTURE_H_
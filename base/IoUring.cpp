@@ -0,0 +1,226 @@
+#include "IoUring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "BaseUtil.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//IORING_OP_WRITE and the writes at the file position came with linux 5.6
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+
+IoUring::IoUring():
+    fd_(-1),
+    entries_(0),
+    sqHead_(nullptr),
+    sqTail_(nullptr),
+    sqMask_(nullptr),
+    sqArray_(nullptr),
+    sqes_(nullptr),
+    cqHead_(nullptr),
+    cqTail_(nullptr),
+    cqMask_(nullptr),
+    cqes_(nullptr),
+    sqRing_(MAP_FAILED),
+    sqRingSize_(0),
+    cqRing_(MAP_FAILED),
+    cqRingSize_(0),
+    sqesSize_(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    if(sqes_)
+    {
+        munmap(sqes_, sqesSize_);
+    }
+
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        munmap(cqRing_, cqRingSize_);
+    }
+
+    if(sqRing_ != MAP_FAILED)
+    {
+        munmap(sqRing_, sqRingSize_);
+    }
+
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+bool IoUring::init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    if(!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sqRingSize_ = sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_;
+        cqRingSize_ = sqRingSize_;
+    }
+
+    fd_ = fd;
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED)
+        {
+            return false;
+        }
+    }
+
+    sqesSize_ = p.sq_entries*sizeof(struct io_uring_sqe);
+    void * sqes = mmap(nullptr, sqesSize_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+    char * sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+
+    char * cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    entries_ = p.sq_entries;
+    return true;
+}
+
+bool IoUring::write(int fd, const void * buf, size_t len, int64_t offset, uint64_t data)
+{
+    unsigned tail = *sqTail_;
+    if(tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= entries_)
+    {
+        return false;
+    }
+
+    unsigned index = tail & *sqMask_;
+    struct io_uring_sqe * sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = static_cast<uint64_t>(offset);
+    sqe->user_data = data;
+
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+    int ret = 0;
+    do
+    {
+        ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0));
+    } while(ret < 0 && errno == EINTR);
+
+    //without SQPOLL the kernel reads the ring only in io_uring_enter, so an sqe
+    //it didn't take is taken back, else a later submit would write the buffer
+    //the caller reused; a taken sqe completes even if enter failed
+    if(__atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == tail + 1)
+    {
+        return true;
+    }
+
+    __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+    return false;
+}
+
+//the transient errors are retried, a completion left in the ring would be
+//reaped by a later wait() for another write
+bool IoUring::wait(int * res, uint64_t * data)
+{
+    while(entries_ > 0)
+    {
+        unsigned head = *cqHead_;
+        if(head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe * cqe = &cqes_[head & *cqMask_];
+            *data = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if(ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            entries_ = 0; // no write may reuse the ring, its completions are lost
+        }
+    }
+
+    return false;
+}
+
+#else
+
+bool IoUring::init(unsigned entries)
+{
+    NOTUSED_ARG(entries);
+    return false;
+}
+
+bool IoUring::write(int fd, const void * buf, size_t len, int64_t offset, uint64_t data)
+{
+    NOTUSED_ARG(fd);
+    NOTUSED_ARG(buf);
+    NOTUSED_ARG(len);
+    NOTUSED_ARG(offset);
+    NOTUSED_ARG(data);
+    return false;
+}
+
+bool IoUring::wait(int * res, uint64_t * data)
+{
+    NOTUSED_ARG(res);
+    NOTUSED_ARG(data);
+    return false;
+}
+
+#endif // HAVE_IO_URING
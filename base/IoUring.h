@@ -0,0 +1,62 @@
+#ifndef _IO_URING_H_
+#define _IO_URING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/*
+   IoUring: a minimal io_uring on the raw syscalls, just what the log file
+   needs, writes at the file position and their completions; init() fails
+   on the kernels or the headers without IORING_OP_WRITE, the caller then
+   writes by itself, a failed IoUring is dropped
+
+   not thread safe, one submitter and one reaper, the same thread
+ */
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    bool init(unsigned entries);
+    bool valid() const { return entries_ > 0; }
+
+    //queue a write at offset and submit it, -1 writes at the file position
+    //(needed for an O_APPEND fd), data comes back from wait(); true if the
+    //kernel took it, buf is in use until its completion, false if it was
+    //taken back, nothing refers to buf then
+    bool write(int fd, const void * buf, size_t len, int64_t offset, uint64_t data);
+
+    //wait for a completion, res is its result, -errno if the write failed;
+    //false if the ring failed, nothing was reaped and the ring is not valid
+    //any more, the writes in flight may still touch their buffers
+    bool wait(int * res, uint64_t * data);
+private:
+    IoUring(const IoUring &);
+    IoUring & operator=(const IoUring &);
+
+    int fd_;
+    unsigned entries_;
+
+    unsigned * sqHead_;
+    unsigned * sqTail_;
+    unsigned * sqMask_;
+    unsigned * sqArray_;
+    struct io_uring_sqe * sqes_;
+
+    unsigned * cqHead_;
+    unsigned * cqTail_;
+    unsigned * cqMask_;
+    struct io_uring_cqe * cqes_;
+
+    void * sqRing_;
+    size_t sqRingSize_;
+    void * cqRing_;
+    size_t cqRingSize_;
+    size_t sqesSize_;
+};
+
+#endif // _IO_URING_H_
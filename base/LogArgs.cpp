@@ -0,0 +1,497 @@
+#include "LogArgs.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "Buffer.h"
+#include "Logger.h"
+
+namespace
+{
+
+struct LogArg
+{
+    int type_;
+    int64_t i_;
+    uint64_t u_;
+    double d_;
+    const char * str_;
+};
+
+class LogArgReader
+{
+public:
+    LogArgReader(const char * args, size_t len):pos_(args), end_(args + len) {}
+
+    bool next(LogArg & arg)
+    {
+        if(pos_ >= end_)
+        {
+            return false;
+        }
+
+        arg.type_ = static_cast<uint8_t>(*pos_++);
+        arg.i_ = 0;
+        arg.u_ = 0;
+        arg.d_ = 0;
+        arg.str_ = "";
+        switch(arg.type_)
+        {
+        case LOG_ARG_INT32:
+            {
+                int32_t v;
+                if(!get(&v, sizeof(v))) return false;
+                arg.i_ = v;
+                arg.u_ = static_cast<uint32_t>(v);
+                arg.d_ = v;
+            }
+            break;
+        case LOG_ARG_UINT32:
+            {
+                uint32_t v;
+                if(!get(&v, sizeof(v))) return false;
+                arg.i_ = v;
+                arg.u_ = v;
+                arg.d_ = v;
+            }
+            break;
+        case LOG_ARG_INT64:
+            if(!get(&arg.i_, sizeof(arg.i_))) return false;
+            arg.u_ = static_cast<uint64_t>(arg.i_);
+            arg.d_ = static_cast<double>(arg.i_);
+            break;
+        case LOG_ARG_UINT64:
+        case LOG_ARG_POINTER:
+            if(!get(&arg.u_, sizeof(arg.u_))) return false;
+            arg.i_ = static_cast<int64_t>(arg.u_);
+            arg.d_ = static_cast<double>(arg.u_);
+            break;
+        case LOG_ARG_DOUBLE:
+            if(!get(&arg.d_, sizeof(arg.d_))) return false;
+            arg.i_ = static_cast<int64_t>(arg.d_);
+            arg.u_ = static_cast<uint64_t>(arg.i_);
+            break;
+        case LOG_ARG_STRING:
+            {
+                uint16_t len;
+                if(!get(&len, sizeof(len)) || end_ - pos_ < len + 1 || pos_[len] != '\0') return false;
+                arg.str_ = pos_;
+                pos_ += len + 1;
+            }
+            break;
+        default:
+            pos_ = end_;
+            return false;
+        }
+
+        return true;
+    }
+private:
+    bool get(void * v, size_t len)
+    {
+        if(static_cast<size_t>(end_ - pos_) < len)
+        {
+            pos_ = end_;
+            return false;
+        }
+
+        memcpy(v, pos_, len);
+        pos_ += len;
+        return true;
+    }
+
+    const char * pos_;
+    const char * end_;
+};
+
+void appendf(std::string & data, const char * format, ...)
+{
+    char buf[128];
+
+    va_list arglist1, arglist2;
+    va_start(arglist1, format);
+    va_copy(arglist2, arglist1);
+
+    int len = vsnprintf(buf, sizeof(buf), format, arglist1);
+    if(len >= 0 && static_cast<size_t>(len) < sizeof(buf))
+    {
+        data.append(buf, len);
+    }
+    else if(len > 0)
+    {
+        size_t size = data.size();
+        data.resize(size + len + 1);
+        vsnprintf(&data[size], len + 1, format, arglist2);
+        data.resize(size + len);
+    }
+
+    va_end(arglist1);
+    va_end(arglist2);
+}
+
+//a '*' width or precision takes an int arg
+void appendStar(std::string & spec, LogArgReader & reader, bool precision)
+{
+    LogArg arg;
+    int v = reader.next(arg) ? static_cast<int>(arg.i_) : 0;
+    if(precision && v < 0)
+    {
+        spec.resize(spec.size() - 1); // a negative precision is no precision
+        return;
+    }
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", v);
+    spec.append(buf);
+}
+
+template<typename T>
+void putRaw(Buffer & buf, T v)
+{
+    buf.append(&v, sizeof(v));
+}
+
+void putStr(Buffer & buf, const char * str)
+{
+    size_t len = strlen(str);
+    len = len < UINT16_MAX ? len : UINT16_MAX;
+    putRaw(buf, static_cast<uint16_t>(len));
+    buf.append(str, len);
+}
+
+}
+
+void LogArgWriter::put(const char * s)
+{
+    s = s ? s : "(null)";
+    size_t len = strlen(s);
+    if(!ok_ || len > UINT16_MAX || static_cast<size_t>(end_ - pos_) < len + 4)
+    {
+        ok_ = false;
+        return;
+    }
+
+    uint16_t len16 = static_cast<uint16_t>(len);
+    *pos_++ = static_cast<char>(LOG_ARG_STRING);
+    memcpy(pos_, &len16, sizeof(len16));
+    pos_ += sizeof(len16);
+    memcpy(pos_, s, len + 1);
+    pos_ += len + 1;
+}
+
+void formatLogArgs(std::string & data, const char * fmt, const char * args, size_t len)
+{
+    LogArgReader reader(args, len);
+    std::string spec;
+
+    const char * p = fmt;
+    while(*p)
+    {
+        const char * percent = strchr(p, '%');
+        if(!percent)
+        {
+            data.append(p);
+            break;
+        }
+
+        data.append(p, percent - p);
+        p = percent + 1;
+        if(*p == '%')
+        {
+            data.push_back('%');
+            ++p;
+            continue;
+        }
+
+        //rebuild the conversion without its length, the arg knows its size
+        spec.assign("%");
+        while(*p && strchr("-+ #0'", *p))
+        {
+            spec.push_back(*p++);
+        }
+
+        if(*p == '*')
+        {
+            appendStar(spec, reader, false);
+            ++p;
+        }
+        while(isdigit(static_cast<unsigned char>(*p)))
+        {
+            spec.push_back(*p++);
+        }
+
+        if(*p == '.')
+        {
+            spec.push_back(*p++);
+            if(*p == '*')
+            {
+                appendStar(spec, reader, true);
+                ++p;
+            }
+            while(isdigit(static_cast<unsigned char>(*p)))
+            {
+                spec.push_back(*p++);
+            }
+        }
+
+        while(*p && strchr("hlLqjzt", *p))
+        {
+            ++p;
+        }
+
+        char conv = *p;
+        if(!conv)
+        {
+            break;
+        }
+        ++p;
+
+        LogArg arg;
+        if(conv == 'n' || !reader.next(arg))
+        {
+            data.append(percent, p - percent);
+            continue;
+        }
+
+        switch(conv)
+        {
+        case 'd':
+        case 'i':
+            spec.append("lld");
+            appendf(data, spec.c_str(), static_cast<long long>(arg.i_));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec.append("ll");
+            spec.push_back(conv);
+            appendf(data, spec.c_str(), static_cast<unsigned long long>(arg.u_));
+            break;
+        case 'c':
+            spec.push_back('c');
+            appendf(data, spec.c_str(), static_cast<int>(arg.i_));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec.push_back(conv);
+            appendf(data, spec.c_str(), arg.d_);
+            break;
+        case 's':
+            spec.push_back('s');
+            appendf(data, spec.c_str(), arg.type_ == LOG_ARG_STRING ? arg.str_ : "(bad arg)");
+            break;
+        case 'p':
+            spec.push_back('p');
+            appendf(data, spec.c_str(), reinterpret_cast<void *>(static_cast<uintptr_t>(arg.u_)));
+            break;
+        default:
+            data.append(percent, p - percent);
+            break;
+        }
+    }
+}
+
+void LogBinaryWriter::beginChunk(Buffer & buf)
+{
+    ids_.clear();
+    nextId_ = 0;
+
+    putRaw(buf, static_cast<uint8_t>(LOG_BINARY_CHUNK));
+    putRaw(buf, static_cast<uint32_t>(LOG_BINARY_MAGIC));
+}
+
+void LogBinaryWriter::record(Buffer & buf, int64_t time, int tid, int level, const char * fmt,
+                             const char * file, int line, const char * func, const char * args, size_t len)
+{
+    if(buf.empty())
+    {
+        beginChunk(buf);
+    }
+
+    Site site = { fmt, file, line };
+    auto it = ids_.find(site);
+    if(it == ids_.end())
+    {
+        it = ids_.insert(std::make_pair(site, nextId_++)).first;
+
+        putRaw(buf, static_cast<uint8_t>(LOG_BINARY_FORMAT));
+        putRaw(buf, it->second);
+        putRaw(buf, static_cast<int32_t>(line));
+        putStr(buf, fmt);
+        putStr(buf, file);
+        putStr(buf, func);
+    }
+
+    putRaw(buf, static_cast<uint8_t>(LOG_BINARY_RECORD));
+    putRaw(buf, it->second);
+    putRaw(buf, static_cast<int64_t>(time));
+    putRaw(buf, static_cast<int32_t>(tid));
+    putRaw(buf, static_cast<uint8_t>(level));
+    putRaw(buf, static_cast<uint16_t>(len));
+    buf.append(args, len);
+}
+
+void LogBinaryWriter::text(Buffer & buf, const char * line, size_t len)
+{
+    if(buf.empty())
+    {
+        beginChunk(buf);
+    }
+
+    putRaw(buf, static_cast<uint8_t>(LOG_BINARY_TEXT));
+    putRaw(buf, static_cast<uint32_t>(len));
+    buf.append(line, len);
+}
+
+namespace
+{
+
+class EntryReader
+{
+public:
+    EntryReader(const char * data, size_t len):pos_(data), end_(data + len) {}
+
+    template<typename T>
+    bool get(T & v)
+    {
+        if(static_cast<size_t>(end_ - pos_) < sizeof(v))
+        {
+            return false;
+        }
+
+        memcpy(&v, pos_, sizeof(v));
+        pos_ += sizeof(v);
+        return true;
+    }
+
+    bool get(const char *& data, size_t len)
+    {
+        if(static_cast<size_t>(end_ - pos_) < len)
+        {
+            return false;
+        }
+
+        data = pos_;
+        pos_ += len;
+        return true;
+    }
+
+    bool getStr(std::string & str)
+    {
+        uint16_t len;
+        const char * data;
+        if(!get(len) || !get(data, len))
+        {
+            return false;
+        }
+
+        str.assign(data, len);
+        return true;
+    }
+
+    const char * pos() const { return pos_; }
+private:
+    const char * pos_;
+    const char * end_;
+};
+
+}
+
+ssize_t LogBinaryReader::decode(const char * data, size_t len, std::string & out)
+{
+    std::string msg;
+    std::string line;
+
+    const char * begin = data;
+    EntryReader reader(data, len);
+    while(true)
+    {
+        uint8_t type;
+        if(!reader.get(type))
+        {
+            break;
+        }
+
+        if(type == LOG_BINARY_CHUNK)
+        {
+            uint32_t magic;
+            if(!reader.get(magic))
+            {
+                break;
+            }
+
+            if(magic != LOG_BINARY_MAGIC)
+            {
+                return -1;
+            }
+
+            formats_.clear();
+        }
+        else if(type == LOG_BINARY_FORMAT)
+        {
+            uint32_t id;
+            Format format;
+            if(!reader.get(id) || !reader.get(format.line_) || !reader.getStr(format.fmt_) ||
+               !reader.getStr(format.file_) || !reader.getStr(format.func_))
+            {
+                break;
+            }
+
+            formats_[id] = format;
+        }
+        else if(type == LOG_BINARY_RECORD)
+        {
+            uint32_t id;
+            int64_t time;
+            int32_t tid;
+            uint8_t level;
+            uint16_t argsLen;
+            const char * args;
+            if(!reader.get(id) || !reader.get(time) || !reader.get(tid) || !reader.get(level) ||
+               !reader.get(argsLen) || !reader.get(args, argsLen))
+            {
+                break;
+            }
+
+            auto it = formats_.find(id);
+            if(it == formats_.end() || level >= Logger::NUM_LEVELS)
+            {
+                return -1;
+            }
+
+            const Format & format = it->second;
+            msg.clear();
+            formatLogArgs(msg, format.fmt_.c_str(), args, argsLen);
+            Logger::format(line, time, static_cast<Logger::LogLevel>(level), tid, msg.data(), msg.size(),
+                           format.file_.c_str(), format.line_, format.func_.c_str());
+            out.append(line);
+        }
+        else if(type == LOG_BINARY_TEXT)
+        {
+            uint32_t textLen;
+            const char * text;
+            if(!reader.get(textLen) || !reader.get(text, textLen))
+            {
+                break;
+            }
+
+            out.append(text, textLen);
+        }
+        else
+        {
+            return -1;
+        }
+
+        begin = reader.pos();
+    }
+
+    return begin - data;
+}
@@ -0,0 +1,158 @@
+#ifndef _LOG_ARGS_H_
+#define _LOG_ARGS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string.h>
+#include <string>
+#include <map>
+
+/*
+   the args of a deferred log line: a type byte then the raw value, a string
+   is copied with a 2 byte length and its '\0', char/short/bool are promoted
+   to int like printf does; the line is formatted later by formatLogArgs, in the log
+   thread or by the logdecode tool
+ */
+enum
+{
+    LOG_ARG_INT32 = 1,
+    LOG_ARG_UINT32,
+    LOG_ARG_INT64,
+    LOG_ARG_UINT64,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_POINTER,
+    LOG_ARG_STRING
+};
+
+class LogArgWriter
+{
+public:
+    LogArgWriter(char * buf, size_t len):begin_(buf), pos_(buf), end_(buf + len), ok_(true) {}
+
+    void put(int v) { putValue(LOG_ARG_INT32, &v, sizeof(v)); }
+    void put(unsigned int v) { putValue(LOG_ARG_UINT32, &v, sizeof(v)); }
+    void put(long v) { put(static_cast<long long>(v)); }
+    void put(unsigned long v) { put(static_cast<unsigned long long>(v)); }
+    void put(long long v) { int64_t i = v; putValue(LOG_ARG_INT64, &i, sizeof(i)); }
+    void put(unsigned long long v) { uint64_t u = v; putValue(LOG_ARG_UINT64, &u, sizeof(u)); }
+    void put(double v) { putValue(LOG_ARG_DOUBLE, &v, sizeof(v)); }
+    void put(const void * p) { uint64_t u = reinterpret_cast<uintptr_t>(p); putValue(LOG_ARG_POINTER, &u, sizeof(u)); }
+    void put(char * s) { put(static_cast<const char *>(s)); }
+    void put(const char * s);
+
+    template<typename T>
+    void put(T * p) { put(static_cast<const void *>(p)); }
+
+    void putAll() {}
+
+    template<typename T, typename... Args>
+    void putAll(T v, Args... args)
+    {
+        put(v);
+        putAll(args...);
+    }
+
+    //false if the args didn't fit
+    bool ok() const { return ok_; }
+    size_t size() const { return pos_ - begin_; }
+private:
+    void putValue(uint8_t type, const void * v, size_t len)
+    {
+        if(!ok_ || static_cast<size_t>(end_ - pos_) < len + 1)
+        {
+            ok_ = false;
+            return;
+        }
+
+        *pos_++ = static_cast<char>(type);
+        memcpy(pos_, v, len);
+        pos_ += len;
+    }
+
+    char * begin_;
+    char * pos_;
+    char * end_;
+    bool ok_;
+};
+
+//format fmt with the args encoded by LogArgWriter and append it to data,
+//an arg missing or of another type than the conversion is converted or skipped
+void formatLogArgs(std::string & data, const char * fmt, const char * args, size_t len);
+
+/*
+   the binary log file: a sequence of chunks, each chunk starts with
+   LOG_BINARY_CHUNK and the magic, and defines the formats it uses before
+   the records that use them, so a chunk decodes on its own; little endian
+
+   chunk:  'C' uint32 magic
+   format: 'F' uint32 id, int32 line, uint16 len + fmt, uint16 len + file, uint16 len + func
+   record: 'R' uint32 id, int64 time, int32 tid, uint8 level, uint16 len + args
+   text:   'T' uint32 len + a formatted line, for the lines not deferred
+ */
+#define LOG_BINARY_MAGIC 0x474f4c47 // "GLOG"
+
+enum
+{
+    LOG_BINARY_CHUNK = 'C',
+    LOG_BINARY_FORMAT = 'F',
+    LOG_BINARY_RECORD = 'R',
+    LOG_BINARY_TEXT = 'T'
+};
+
+class Buffer;
+
+class LogBinaryWriter
+{
+public:
+    LogBinaryWriter():nextId_(0) {}
+
+    //begin a chunk when the buffer is empty, the formats are defined again
+    void record(Buffer & buf, int64_t time, int tid, int level, const char * fmt,
+                const char * file, int line, const char * func, const char * args, size_t len);
+    void text(Buffer & buf, const char * line, size_t len);
+private:
+    void beginChunk(Buffer & buf);
+
+    struct Site
+    {
+        const char * fmt_;
+        const char * file_;
+        int line_;
+
+        bool operator<(const Site & site) const
+        {
+            if(fmt_ != site.fmt_) return fmt_ < site.fmt_;
+            if(file_ != site.file_) return file_ < site.file_;
+            return line_ < site.line_;
+        }
+    };
+
+    std::map<Site, uint32_t> ids_; // the formats defined in the chunk
+    uint32_t nextId_;
+};
+
+/*
+   LogBinaryReader: decode a binary log file into text lines, the input may
+   end in the middle of an entry, the partial entry is left unread
+ */
+class LogBinaryReader
+{
+public:
+    LogBinaryReader() {}
+
+    //decode the entries in data, append the lines to out, return the bytes used, -1 if corrupted
+    ssize_t decode(const char * data, size_t len, std::string & out);
+private:
+    struct Format
+    {
+        int line_;
+        std::string fmt_;
+        std::string file_;
+        std::string func_;
+    };
+
+    std::map<uint32_t, Format> formats_; // the formats of the current chunk
+};
+
+#endif // _LOG_ARGS_H_
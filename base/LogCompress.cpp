@@ -0,0 +1,246 @@
+#include "LogCompress.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <vector>
+#include <functional>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "CurrentThread.h"
+
+//ioprio_set has no glibc wrapper
+#define LOG_IOPRIO_WHO_PROCESS 1
+#define LOG_IOPRIO_CLASS_IDLE (3 << 13)
+
+//the gzip wrapper of deflate
+#define LOG_GZIP_WINDOW_BITS (15 + 16)
+
+namespace
+{
+
+ssize_t readFull(int fd, char * data, size_t len)
+{
+    size_t total = 0;
+    while(total < len)
+    {
+        ssize_t n = ::read(fd, data + total, len - total);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        if(n == 0)
+        {
+            break;
+        }
+        total += n;
+    }
+
+    return total;
+}
+
+bool writeFull(int fd, const char * data, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+}
+
+LogCompress::LogCompress(int level, size_t rate):
+    level_(level),
+    rate_(rate),
+    running_(true)
+{
+    thread_ = std::thread(std::bind(&LogCompress::threadFunc, this));
+}
+
+LogCompress::~LogCompress()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+
+    cond_.notify_one();
+    thread_.join();
+}
+
+void LogCompress::compress(const std::string & filename)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        files_.push_back(filename);
+    }
+
+    cond_.notify_one();
+}
+
+void LogCompress::threadFunc()
+{
+    //in the background of the process, the log writer and the service go first
+    int tid = CurrentThread::tid();
+    setpriority(PRIO_PROCESS, tid, 19);
+    syscall(SYS_ioprio_set, LOG_IOPRIO_WHO_PROCESS, tid, LOG_IOPRIO_CLASS_IDLE);
+
+    while(true)
+    {
+        std::string filename;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !running_ || !files_.empty(); });
+            if(!running_)
+            {
+                //the files left are kept as they are
+                break;
+            }
+
+            filename = files_.front();
+            files_.pop_front();
+        }
+
+        compressFile(filename);
+    }
+}
+
+bool LogCompress::compressFile(const std::string & filename)
+{
+    int in = ::open(filename.c_str(), O_RDONLY|O_CLOEXEC);
+    if(in < 0)
+    {
+        fprintf(stderr, "open logfile=%s,error=%s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::string gzname = filename + ".gz";
+    int out = ::open(gzname.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if(out < 0)
+    {
+        fprintf(stderr, "create logfile=%s,error=%s\n", gzname.c_str(), strerror(errno));
+        ::close(in);
+        return false;
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, level_, Z_DEFLATED, LOG_GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        fprintf(stderr, "compress logfile=%s,error=bad level %d\n", filename.c_str(), level_);
+        ::close(in);
+        ::close(out);
+        ::unlink(gzname.c_str());
+        return false;
+    }
+
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> src(LOG_COMPRESS_CHUNK);
+    std::vector<char> dst(deflateBound(&zs, LOG_COMPRESS_CHUNK));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t total = 0;
+    bool ok = true;
+    const char * error = nullptr;
+
+    //an empty file still gets one member, an empty .gz is not a gzip file
+    ssize_t n = 0;
+    do
+    {
+        n = readFull(in, src.data(), src.size());
+        if(n < 0)
+        {
+            error = strerror(errno);
+            ok = false;
+            break;
+        }
+
+        //the source is read once and removed, keep it out of the page cache
+        posix_fadvise(in, total, n, POSIX_FADV_DONTNEED);
+        total += n;
+
+        //one member per chunk, a truncated .gz loses only its last chunk
+        zs.next_in = reinterpret_cast<Bytef *>(src.data());
+        zs.avail_in = static_cast<uInt>(n);
+        zs.next_out = reinterpret_cast<Bytef *>(dst.data());
+        zs.avail_out = static_cast<uInt>(dst.size());
+        if(deflate(&zs, Z_FINISH) != Z_STREAM_END)
+        {
+            error = "deflate failed";
+            ok = false;
+            break;
+        }
+
+        if(!writeFull(out, dst.data(), dst.size() - zs.avail_out))
+        {
+            error = strerror(errno);
+            ok = false;
+            break;
+        }
+        deflateReset(&zs);
+
+        if(!throttle(start, total))
+        {
+            ok = false;
+            break;
+        }
+    } while(static_cast<size_t>(n) == src.size());
+
+    deflateEnd(&zs);
+    ::close(in);
+
+    //the .gz must be on the disk before its source goes away
+    if(ok && ::fdatasync(out) != 0)
+    {
+        error = strerror(errno);
+        ok = false;
+    }
+    ::close(out);
+
+    if(!ok)
+    {
+        if(error)
+        {
+            fprintf(stderr, "compress logfile=%s,error=%s\n", filename.c_str(), error);
+        }
+        ::unlink(gzname.c_str());
+        return false;
+    }
+
+    ::unlink(filename.c_str());
+    return true;
+}
+
+bool LogCompress::throttle(const std::chrono::steady_clock::time_point & start, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(rate_ > 0)
+    {
+        std::chrono::steady_clock::time_point due = start + std::chrono::microseconds(bytes*1000000/rate_);
+        cond_.wait_until(lock, due, [this] { return !running_; });
+    }
+
+    return running_;
+}
@@ -0,0 +1,54 @@
+#ifndef _LOG_COMPRESS_H_
+#define _LOG_COMPRESS_H_
+
+#include <string>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define DEF_LOG_COMPRESS_RATE 32 // MB per second
+#define LOG_COMPRESS_CHUNK 1024*1024
+#define LOG_COMPRESS_MAX_LEVEL 9
+
+/*
+   LogCompress: gzip the rolled log files on a background thread
+
+   every LOG_COMPRESS_CHUNK bytes of a file become one complete gzip member,
+   gunzip and zcat read the members as one stream, so the .gz left by a crash
+   decodes up to its last whole chunk; the file is removed only after its .gz
+   is complete and synced
+
+   the thread runs at the lowest cpu priority and the idle io class, and reads
+   at most rate bytes per second, 0 for no limit, the log writer keeps the disk
+ */
+class LogCompress
+{
+public:
+    LogCompress(int level, size_t rate);
+    ~LogCompress();
+
+    //queue a closed log file, it becomes filename.gz
+    void compress(const std::string & filename);
+private:
+    LogCompress(const LogCompress &);
+    LogCompress & operator=(const LogCompress &);
+
+    void threadFunc();
+    bool compressFile(const std::string & filename);
+
+    //sleep until bytes are due at rate_, false when stopping
+    bool throttle(const std::chrono::steady_clock::time_point & start, size_t bytes);
+
+    int level_;
+    size_t rate_;
+
+    bool running_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::string> files_;
+    std::thread thread_;
+};
+
+#endif // _LOG_COMPRESS_H_
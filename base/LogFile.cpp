@@ -5,16 +5,57 @@
 
 #include "FileOps.h"
 #include "TimeStamp.h"
+#include "Clock.h"
+#include "IoUring.h"
+#include "LogCompress.h"
+
+#define LOG_URING_ENTRIES 4
+#define LOG_BUFFER_ALIGN 4096
 
 LogFile::LogFile():
     logFolder_("log"),
     baseName_("default"),
+    suffix_(".log"),
     rollSize_(DEF_ROLLSIZE),
     flushInterval_(DEF_FLUSHINTERVAL),
     autoRm_(DEF_AUTORM*DAYILY_SECONDS),
-    lastFlush_(0)
+    bufferSize_(DEF_LOG_BUFFER_SIZE),
+    sync_(false),
+    lastFlush_(0),
+    nextDay_(0)
+{
+
+}
+
+LogFile::~LogFile()
+{
+    fileObj_.reset();
+}
+
+//only before the first line, the files keep the ring
+bool LogFile::setIoUring(bool on)
 {
+    uring_.reset();
+    if(on)
+    {
+        uring_.reset(new IoUring());
+        if(!uring_->init(LOG_URING_ENTRIES))
+        {
+            uring_.reset();
+            return false;
+        }
+    }
+
+    return true;
+}
 
+void LogFile::setCompress(int level, size_t rate)
+{
+    compress_.reset();
+    if(level > 0)
+    {
+        compress_.reset(new LogCompress(level, rate));
+    }
 }
 
 void LogFile::append(const char * logline)
@@ -24,12 +65,8 @@ void LogFile::append(const char * logline)
 
 void LogFile::append(const char * logline, int len)
 {
-    time_t now = time(NULL) + 8*3600;
-
-    struct tm  tmtime_;
-    gmtime_r(&now, &tmtime_);
-    int nowDay = tmtime_.tm_mday;
-    if(fileDay_ != nowDay || !fileObj_ || fileObj_->getWrittenBytes() + len > rollSize_)
+    time_t now = Clock::toLocal(TimeStamp::time());
+    if(now >= nextDay_ || !fileObj_ || fileObj_->getWrittenBytes() + len > rollSize_)
     {
         rmFile(now);
         rollFile(now);
@@ -37,13 +74,23 @@ void LogFile::append(const char * logline, int len)
 
     if(len > 0)
     {
-        fileObj_->fwrite(logline, len);
+        fileObj_->write(logline, len);
+    }
+    else
+    {
+        //the log thread is idle
+        fileObj_->flush();
     }
 
     if(now - lastFlush_ > flushInterval_)
     {
         lastFlush_ = now;
-        fileObj_->fflush();
+        fileObj_->check();
+        fileObj_->flush();
+        if(sync_)
+        {
+            fileObj_->sync();
+        }
     }
 }
 
@@ -51,12 +98,15 @@ void LogFile::rollFile(const time_t & time)
 {
     std::string filename = getLogFileName(baseName_, time);
 
-    fileObj_.reset(new File(filename));
-
-    struct tm  tmtime_;
-    gmtime_r(&time, &tmtime_);
+    //the old file is closed before it is compressed, a roll in the same second reopens it
+    std::string oldname = fileObj_ ? fileObj_->getFileName() : std::string();
+    fileObj_.reset(new File(filename, bufferSize_, uring_.get()));
+    if(compress_ && !oldname.empty() && oldname != filename)
+    {
+        compress_->compress(oldname);
+    }
 
-    fileDay_ = tmtime_.tm_mday;
+    nextDay_ = (time/DAYILY_SECONDS + 1)*DAYILY_SECONDS;
 }
 
 void LogFile::rmFile(const time_t & time)
@@ -81,7 +131,7 @@ std::string LogFile::getLogFileName(const std::string & basename, const time_t &
     mkdir(filename.c_str(), 0755);
     strftime(timebuf, sizeof(timebuf), ".%Y%m%d-%H%M%S", &tm);
 
-    filename += basename + timebuf + ".log";
+    filename += basename + timebuf + suffix_;
     return filename;
 }
 
@@ -98,3 +148,191 @@ std::string LogFile::getLogPath(const time_t & time)
     return logPath;
 }
 
+
+LogFile::File::File(const std::string & filename, size_t bufferSize, IoUring * uring):
+    filename_(filename),
+    fd_(-1),
+    writtenBytes_(0),
+    uring_(uring && uring->valid() ? uring : nullptr),
+    bufferSize_(bufferSize > 0 ? bufferSize : DEF_LOG_BUFFER_SIZE),
+    current_(0),
+    used_(0),
+    inflight_(0)
+{
+    for(int i = 0; i < (uring_ ? 2 : 1); ++i)
+    {
+        void * p = nullptr;
+        if(posix_memalign(&p, LOG_BUFFER_ALIGN, bufferSize_) != 0)
+        {
+            fprintf(stderr, "alloc logfile buffer=%zu failed\n", bufferSize_);
+            abort();
+        }
+        buffers_[i].reset(static_cast<char *>(p));
+    }
+
+    open();
+}
+
+LogFile::File::~File()
+{
+    writeOut();
+    wait();
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool LogFile::File::open()
+{
+    fd_ = ::open(filename_.c_str(), O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    if(fd_ < 0)
+    {
+        fprintf(stderr, "create logfile=%s,error=%s\n", filename_.c_str(), strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void LogFile::File::write(const char * logline, size_t len)
+{
+    writtenBytes_ += len;
+
+    //a large block goes straight out, unless io_uring needs it to stay alive
+    if(used_ == 0 && len >= bufferSize_ && !uring_)
+    {
+        writeFd(logline, len);
+        return;
+    }
+
+    while(len > 0)
+    {
+        size_t n = bufferSize_ - used_;
+        n = n < len ? n : len;
+        memcpy(buffers_[current_].get() + used_, logline, n);
+        used_ += n;
+        logline += n;
+        len -= n;
+
+        if(used_ == bufferSize_)
+        {
+            writeOut();
+        }
+    }
+}
+
+void LogFile::File::flush()
+{
+    writeOut();
+}
+
+void LogFile::File::sync()
+{
+    writeOut();
+    wait();
+    if(fd_ >= 0)
+    {
+        ::fdatasync(fd_);
+    }
+}
+
+void LogFile::File::check()
+{
+    struct stat fst;
+    struct stat st;
+    if(fd_ >= 0 && ::fstat(fd_, &fst) == 0 && ::stat(filename_.c_str(), &st) == 0 &&
+       fst.st_ino == st.st_ino && fst.st_dev == st.st_dev)
+    {
+        return;
+    }
+
+    wait();
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    open();
+}
+
+//with io_uring the buffer is written in the background, one write at a time keeps the order
+void LogFile::File::writeOut()
+{
+    if(used_ == 0)
+    {
+        return;
+    }
+
+    char * buf = buffers_[current_].get();
+    if(uring_ && fd_ >= 0)
+    {
+        wait();
+        //offset -1, at the end of the O_APPEND file like write(2); data is unused
+        if(uring_->write(fd_, buf, used_, -1, 0))
+        {
+            inflight_ = used_;
+            current_ ^= 1;
+            used_ = 0;
+            return;
+        }
+    }
+
+    writeFd(buf, used_);
+    used_ = 0;
+}
+
+void LogFile::File::writeFd(const char * data, size_t len)
+{
+    if(fd_ < 0 && !open())
+    {
+        return;
+    }
+
+    while(len > 0)
+    {
+        ssize_t n = ::write(fd_, data, len);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            fprintf(stderr, "write logfile=%s,error=%s\n", filename_.c_str(), strerror(errno));
+            return;
+        }
+
+        data += n;
+        len -= n;
+    }
+}
+
+void LogFile::File::wait()
+{
+    if(inflight_ == 0)
+    {
+        return;
+    }
+
+    uint64_t data = 0;
+    int res = 0;
+    size_t len = inflight_;
+    inflight_ = 0;
+    if(!uring_->wait(&res, &data))
+    {
+        //the kernel may still write from the buffer, so it is never reused, the
+        //file goes on with synchronous writes; if the write didn't happen it is lost
+        fprintf(stderr, "io_uring wait logfile=%s,error=%s, %zu bytes may be lost\n", filename_.c_str(), strerror(errno), len);
+        buffers_[current_ ^ 1].release();
+        uring_ = nullptr;
+        return;
+    }
+
+    //the rest of a short or failed write goes synchronously
+    const char * buf = buffers_[current_ ^ 1].get();
+    size_t written = res > 0 ? static_cast<size_t>(res) : 0;
+    if(written < len)
+    {
+        writeFd(buf + written, len - written);
+    }
+}
@@ -18,10 +18,26 @@
 #define DEF_AUTORM 15
 #define DAYILY_SECONDS 24*60*60
 
+#define DEF_LOG_BUFFER_SIZE 1024*1024
+
+class IoUring;
+class LogCompress;
+
+/*
+   LogFile: the log files of one base name, rolled by day and size
+
+   written through a raw O_APPEND fd from large aligned buffers, with io_uring
+   the full buffer is written while the next one fills; the file is checked
+   with fstat on the flush interval instead of a stat per write, a removed
+   file is created again within an interval, and the writes are synced
+   then with fdatasync if Sync is set; a rolled file is gzipped in the
+   background when a compress level is set
+ */
 class LogFile
 {
 public:
     LogFile();
+    ~LogFile();
 
     void append(const char * logline);
     void append(const char * logline, int len);
@@ -31,6 +47,13 @@ public:
     void setRollSize(size_t rollSize) { rollSize_ = rollSize; }
     void setFlushInterval(int flushInterval) { flushInterval_ = flushInterval; }
     void setAutoRm(int autoRm) { autoRm_ = autoRm; }
+    void setSuffix(const std::string & suffix) { suffix_ = suffix; }
+    void setBufferSize(size_t bufferSize) { bufferSize_ = bufferSize; }
+    void setSync(bool sync) { sync_ = sync; }
+    //false if io_uring is not supported here, the writes stay synchronous
+    bool setIoUring(bool on);
+    //gzip the rolled files at level 1-9 reading rate bytes per second, 0 stops it
+    void setCompress(int level, size_t rate);
 private:
     void rollFile(const time_t & time);
     void rmFile(const time_t & time);
@@ -40,65 +63,64 @@ private:
     class File
     {
     public:
-        File(std::string & filename):
-            filename_(filename),
-            fp_(::fopen(filename_.c_str(), "a")),
-            writtenBytes_(0)
-            {
-                if(!fp_) fprintf(stderr, "create logfile=%s,error=%s\n", filename_.c_str(), strerror(errno));
-            }
-
-        ~File() { fclose(); }
+        File(const std::string & filename, size_t bufferSize, IoUring * uring);
+        ~File();
     public:
         size_t getWrittenBytes() { return writtenBytes_; }
+        const std::string & getFileName() const { return filename_; }
 
-        size_t fwrite(const char * logline, const size_t len)
-        {
-            if(!fopen())
-            {
-                return 0;
-            }
+        void write(const char * logline, size_t len);
 
-            writtenBytes_ += len;
-            return ::fwrite(logline, 1, len, fp_);
-        }
+        //hand the buffered lines to the kernel
+        void flush();
 
-        void fflush()
-        {
-            if(fp_) ::fflush(fp_);
-        }
+        //flush, wait for the write in flight and fdatasync
+        void sync();
 
-        void fclose()
-        {
-            if(fp_) ::fclose(fp_);
-        }
+        //reopen the file if it was removed or renamed away
+        void check();
+    private:
+        File(const File &);
+        File & operator=(const File &);
+
+        bool open();
+        void writeOut();
+        void writeFd(const char * data, size_t len);
+        void wait();
 
-        bool fopen()
+        struct FreeDeleter
         {
-            if(!fp_ || !base::isFile(filename_))
-            {
-                fclose();
-                fp_ = ::fopen(filename_.c_str(), "a");
-            }
-
-            return fp_ != nullptr;
-        }
-    private:
+            void operator()(char * p) const { ::free(p); }
+        };
+        typedef std::unique_ptr<char, FreeDeleter> AlignedBuffer;
+
         std::string filename_;
-        FILE * fp_;
+        int fd_;
         size_t writtenBytes_;
+
+        IoUring * uring_; // null for the synchronous writes
+        size_t bufferSize_;
+        AlignedBuffer buffers_[2]; // one fills while the other is written
+        int current_;
+        size_t used_;
+        size_t inflight_; // the bytes of the io_uring write in flight
     };
 
 private:
     std::string logFolder_;
     std::string baseName_;
+    std::string suffix_; // the file extension, ".log"
     size_t      rollSize_;
     int         flushInterval_;
     int         autoRm_;
+    size_t      bufferSize_;
+    bool        sync_;
 
     time_t lastFlush_;
-    int fileDay_;
+    time_t nextDay_; // roll when the time gets here
 
+    std::unique_ptr<LogCompress> compress_;
+    std::unique_ptr<IoUring> uring_;
     std::unique_ptr<File> fileObj_;
 };
 
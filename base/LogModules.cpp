@@ -0,0 +1,133 @@
+#include "LogModules.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <mutex>
+#include <vector>
+
+#include "BaseUtil.h"
+
+std::atomic<uint8_t> LogModules::levels_[LOG_MAX_MODULES];
+
+namespace
+{
+
+//the modules seen so far, only touched on the slow paths
+struct ModuleTable
+{
+    ModuleTable():level_(Logger::INFO)
+    {
+        //id 0 is the default module, for the modules over LOG_MAX_MODULES
+        names_.push_back("");
+    }
+
+    std::mutex mutex_;
+    std::vector<std::string> names_; // indexed by the module id
+    std::map<std::string, int> levels_; // the configured modules
+    int level_; // the level of the other modules
+
+    uint8_t levelOf(const std::string & name)
+    {
+        auto it = levels_.find(name);
+        return static_cast<uint8_t>(it != levels_.end() ? it->second : level_);
+    }
+};
+
+ModuleTable & getModuleTable()
+{
+    static ModuleTable table;
+    return table;
+}
+
+const char * g_levelNames[Logger::NUM_LEVELS] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+
+}
+
+void LogModules::setLevels(int level, const std::map<std::string, int> & levels)
+{
+    ModuleTable & table = getModuleTable();
+    std::unique_lock<std::mutex> lock(table.mutex_);
+    table.level_ = level;
+    table.levels_ = levels;
+    for(size_t i = 0; i < table.names_.size(); ++i)
+    {
+        levels_[i].store(table.levelOf(table.names_[i]), std::memory_order_relaxed);
+    }
+}
+
+void LogModules::parseLevels(const std::string & str, std::map<std::string, int> & levels)
+{
+    std::vector<std::string> modules;
+    base::splitex(str, ", ", modules);
+    for(size_t i = 0; i < modules.size(); ++i)
+    {
+        std::vector<std::string> pair;
+        base::splitex(modules[i], ":=", pair);
+        if(pair.size() == 2)
+        {
+            levels[pair[0]] = parseLevel(pair[1], Logger::INFO);
+        }
+    }
+}
+
+int LogModules::parseLevel(const std::string & str, int defLevel)
+{
+    if(str.empty())
+    {
+        return defLevel;
+    }
+
+    if(isdigit(static_cast<unsigned char>(str[0])))
+    {
+        int level = atoi(str.c_str());
+        return level < Logger::NUM_LEVELS ? level : defLevel;
+    }
+
+    for(int i = 0; i < Logger::NUM_LEVELS; ++i)
+    {
+        if(strcasecmp(str.c_str(), g_levelNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return defLevel;
+}
+
+int LogModules::resolve(const char * file)
+{
+    //the config sets the levels before the first module gets its id
+    getLogger();
+
+    std::string name = moduleName(file);
+
+    ModuleTable & table = getModuleTable();
+    std::unique_lock<std::mutex> lock(table.mutex_);
+    for(size_t i = 1; i < table.names_.size(); ++i)
+    {
+        if(table.names_[i] == name)
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    if(table.names_.size() >= LOG_MAX_MODULES)
+    {
+        return 0;
+    }
+
+    int id = static_cast<int>(table.names_.size());
+    table.names_.push_back(name);
+    levels_[id].store(table.levelOf(name), std::memory_order_relaxed);
+    return id;
+}
+
+std::string LogModules::moduleName(const char * file)
+{
+    const char * slash = strrchr(file, '/');
+    const char * name = slash ? slash + 1 : file;
+    const char * dot = strrchr(name, '.');
+    return dot ? std::string(name, dot - name) : std::string(name);
+}
@@ -0,0 +1,48 @@
+#ifndef _LOG_MODULES_H_
+#define _LOG_MODULES_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <map>
+
+#define LOG_MAX_MODULES 512
+
+/*
+   LogModules: the runtime log level of every module, a module is a source
+   file name without its extension, so BaseConn.h and BaseConn.cpp share one
+
+   every LOG_ call site caches the id of its module in a constant initialized
+   static, the level check is then one load from a flat table of bytes, the
+   table is rewritten in place when log.conf is reloaded
+ */
+class LogModules
+{
+public:
+    static bool enabled(std::atomic<int> & module, const char * file, int level)
+    {
+        int id = module.load(std::memory_order_relaxed);
+        if(id < 0)
+        {
+            id = resolve(file);
+            module.store(id, std::memory_order_relaxed);
+        }
+
+        return level >= levels_[id].load(std::memory_order_relaxed);
+    }
+
+    //the level of the modules not in levels is level
+    static void setLevels(int level, const std::map<std::string, int> & levels);
+
+    //parse "BaseConn:DEBUG,EventLoop:0" into levels, the names or the numbers of Logger::LogLevel
+    static void parseLevels(const std::string & str, std::map<std::string, int> & levels);
+    static int parseLevel(const std::string & str, int defLevel);
+private:
+    static int resolve(const char * file);
+    static std::string moduleName(const char * file);
+
+    //zero initialized before any constructor runs, resolve() loads the config first
+    static std::atomic<uint8_t> levels_[LOG_MAX_MODULES];
+};
+
+#endif // _LOG_MODULES_H_
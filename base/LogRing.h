@@ -0,0 +1,170 @@
+#ifndef _LOG_RING_H_
+#define _LOG_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+#define LOG_RECORD_SIZE 256
+#define DEF_LOG_RING_SIZE 1024
+
+class Logger;
+
+enum
+{
+    LOG_RECORD_TEXT = 0, // msg_ holds the formatted message
+    LOG_RECORD_ARGS // msg_ holds the format pointer and the args, see LogArgs.h
+};
+
+/*
+   LogRecord: one log line in a fixed size slot, the message is formatted by
+   the logging thread, or only its args are captured and the log thread
+   formats it, the time and the source location by the log thread
+ */
+struct LogRecord
+{
+    static const size_t HeaderSize = 40;
+    static const size_t MaxMsgSize = LOG_RECORD_SIZE - HeaderSize;
+    static const size_t MaxArgsSize = MaxMsgSize - sizeof(const char *);
+    static const uint16_t LargeLen = 0xFFFF; // msg_ holds a Logger * instead
+
+    //a line too long for msg_ keeps its place in the ring as a heap Logger
+    void setLarge(Logger * logger) { len_ = LargeLen; memcpy(msg_, &logger, sizeof(logger)); }
+    Logger * large() const
+    {
+        Logger * logger = nullptr;
+        if(len_ == LargeLen)
+        {
+            memcpy(&logger, msg_, sizeof(logger));
+        }
+        return logger;
+    }
+
+    void setFormat(const char * fmt) { memcpy(msg_, &fmt, sizeof(fmt)); }
+    const char * format() const
+    {
+        const char * fmt = nullptr;
+        memcpy(&fmt, msg_, sizeof(fmt));
+        return fmt;
+    }
+    char * args() { return msg_ + sizeof(const char *); }
+    const char * args() const { return msg_ + sizeof(const char *); }
+
+    int64_t      time_; // microseconds since the epoch
+    const char * file_;
+    const char * func_;
+    int          line_;
+    int          tid_;
+    uint16_t     level_;
+    uint16_t     len_; // the message or the args length
+    uint8_t      kind_;
+    char         pad_[HeaderSize - 37];
+    char         msg_[MaxMsgSize];
+};
+
+static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "LogRecord must fill its slot");
+
+/*
+   LogRing: single producer single consumer ring of LogRecord
+
+   one ring per logging thread, the thread reserves and commits a record
+   without lock or allocation, the log thread drains it
+ */
+class LogRing
+{
+public:
+    explicit LogRing(size_t size = DEF_LOG_RING_SIZE);
+
+    //producer: a free record, null if the ring is full
+    LogRecord * reserve()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if(head - cachedTail_ > mask_)
+        {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if(head - cachedTail_ > mask_)
+            {
+                return nullptr;
+            }
+        }
+
+        return &records_[head & mask_];
+    }
+
+    //producer: publish the reserved record, true if the ring was empty
+    bool commit()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+        return head == tail_.load(std::memory_order_relaxed);
+    }
+
+    //consumer: the oldest record, null if the ring is empty
+    LogRecord * front()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail == cachedHead_)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if(tail == cachedHead_)
+            {
+                return nullptr;
+            }
+        }
+
+        return &records_[tail & mask_];
+    }
+
+    //consumer: release the front record
+    void pop()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    //the producer thread exited, the ring is freed once drained
+    void close() { closed_.store(true, std::memory_order_release); }
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+private:
+    LogRing(const LogRing &);
+    LogRing & operator=(const LogRing &);
+
+    std::unique_ptr<LogRecord[]> records_;
+    size_t mask_;
+
+    //keep the producer and the consumer indexes on their own cache lines
+    char pad0_[64];
+    std::atomic<size_t> head_;
+    size_t cachedTail_; // the producer's copy of tail_
+    char pad1_[64];
+    std::atomic<size_t> tail_;
+    size_t cachedHead_; // the consumer's copy of head_
+    char pad2_[64];
+
+    std::atomic<bool> closed_;
+};
+
+typedef std::shared_ptr<LogRing> LogRingPtr;
+
+inline LogRing::LogRing(size_t size):
+    mask_(0),
+    head_(0),
+    cachedTail_(0),
+    tail_(0),
+    cachedHead_(0),
+    closed_(false)
+{
+    size_t capacity = 2;
+    while(capacity < size)
+    {
+        capacity <<= 1;
+    }
+
+    records_.reset(new LogRecord[capacity]);
+    mask_ = capacity - 1;
+}
+
+#endif // _LOG_RING_H_
@@ -7,9 +7,8 @@
 #include "CurrentThread.h"
 #include "AsyncLogging.h"
 #include "StringOps.h"
-
-static __thread char ttime_[32];
-static __thread time_t t_lastSecond;
+#include "LogRing.h"
+#include "Clock.h"
 
 const char * LogLevelName[Logger::NUM_LEVELS] =
 {
@@ -47,27 +46,30 @@ Logger::Logger(LogLevel level, const char * file, int line, const char * func, c
     va_end(arglist);
 }
 
+Logger::Logger(LogLevel level, const char * file, int line, const char * func, const char * fmt, va_list arglist):
+    level_(level),
+    tid_(CurrentThread::tid()),
+    file_(file),
+    line_(line),
+    func_(func),
+    raw_(false)
+{
+    formatTime();
+    base::vsprintfex(content_, fmt, arglist);
+}
+
 Logger::~Logger()
 {
 }
 
 void Logger::formatTime()
 {
-    TimeStamp ts(TimeStamp::now());
-
-    time_t seconds = ts.seconds() + 8*3600;
-    int microseconds = ts.microseconds()%(1000*1000);
-    if(seconds != t_lastSecond)
-    {
-        t_lastSecond = seconds;
-        struct tm tmtime_;
-        gmtime_r(&seconds, &tmtime_);
-        snprintf(ttime_, sizeof(ttime_), "%4d%02d%02d %02d:%02d:%02d",
-                tmtime_.tm_year + 1900, tmtime_.tm_mon + 1, tmtime_.tm_mday,
-                tmtime_.tm_hour, tmtime_.tm_min, tmtime_.tm_sec);
-    }
+    formatTime(Clock::now(), time_, sizeof(time_));
+}
 
-    snprintf(time_, sizeof(time_), "%s.%06d", ttime_, microseconds);
+void Logger::formatTime(int64_t us, char * buf, size_t len)
+{
+    Clock::formatTime(us, buf, len);
 }
 
 size_t Logger::format(char * data, size_t len)
@@ -109,3 +111,27 @@ void Logger::format(std::string & data)
                     func_);
     }
 }
+
+void Logger::format(std::string & data, const LogRecord & record)
+{
+    format(data, record.time_, static_cast<LogLevel>(record.level_), record.tid_, record.msg_, record.len_,
+           record.file_, record.line_, record.func_);
+}
+
+void Logger::format(std::string & data, int64_t time, LogLevel level, int tid, const char * msg, size_t len,
+                    const char * file, int line, const char * func)
+{
+    char timebuf[64];
+    formatTime(time, timebuf, sizeof(timebuf));
+
+    SourceFile source(file);
+    base::sprintfex(data, "%s [%s][%d] - %.*s -- <%s,%d,%s>\n",
+                timebuf,
+                LogLevelName[level],
+                tid,
+                static_cast<int>(len),
+                msg,
+                source.data(),
+                line,
+                func);
+}
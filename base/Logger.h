@@ -2,6 +2,7 @@
 #define _LOGGER_H_
 
 #include <string.h>
+#include <stdarg.h>
 #include <memory>
 
 #include "TimeStamp.h"
@@ -59,6 +60,7 @@ private:
 };
 
 class Logger;
+struct LogRecord;
 typedef std::shared_ptr<Logger> LoggerPtr;
 #define MakeLoggerPtr std::make_shared<Logger>
 
@@ -78,14 +80,21 @@ public:
 
     Logger(const char * fmt, ...);
     Logger(LogLevel level, const char * file, int line, const char * func, const char * fmt, ...);
+    Logger(LogLevel level, const char * file, int line, const char * func, const char * fmt, va_list arglist);
     ~Logger();
 
     LogLevel level() const { return level_; }
     bool raw() { return raw_; }
     size_t format(char * data, size_t len);
     void format(std::string & data);
+
+    //format a ring record or a decoded line like a Logger
+    static void format(std::string & data, const LogRecord & record);
+    static void format(std::string & data, int64_t time, LogLevel level, int tid, const char * msg, size_t len,
+                       const char * file, int line, const char * func);
 private:
     void formatTime();
+    static void formatTime(int64_t microseconds, char * buf, size_t len);
 
 private:
     LogLevel    level_;
@@ -0,0 +1,106 @@
+#include "LoopWatchdog.h"
+
+#include <stdlib.h>
+#include <cxxabi.h>
+
+#include "BaseUtil.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+
+LoopWatchdog::LoopWatchdog(int stallMs, int checkMs):
+    stallMs_(stallMs > 0 ? stallMs : DEF_STALL_MS),
+    checkMs_(checkMs > 0 ? checkMs : stallMs_/2),
+    running_(false)
+{
+    if(checkMs_ <= 0)
+    {
+        checkMs_ = 1;
+    }
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    stop();
+}
+
+void LoopWatchdog::start()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(running_)
+    {
+        return;
+    }
+
+    running_ = true;
+    thread_ = std::thread(std::bind(&LoopWatchdog::threadFunc, this));
+}
+
+void LoopWatchdog::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!running_)
+        {
+            return;
+        }
+
+        running_ = false;
+        cond_.notify_all();
+    }
+
+    thread_.join();
+}
+
+void LoopWatchdog::threadFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(running_)
+    {
+        cond_.wait_for(lock, std::chrono::milliseconds(checkMs_));
+        if(!running_)
+        {
+            break;
+        }
+
+        int64_t now = TimeStamp::now().microseconds();
+        MetricsRegistry::instance().forEachLoop(std::bind(&LoopWatchdog::checkLoop, this, std::placeholders::_1, now));
+    }
+}
+
+void LoopWatchdog::checkLoop(EventLoop * loop, int64_t now)
+{
+    int64_t begin = 0;
+    const char * name = nullptr;
+    const char * what = nullptr;
+    const char * file = nullptr;
+    int line = 0;
+
+    if(!loop->getCallback(begin, name, what, file, line))
+    {
+        return;
+    }
+
+    int64_t stallUs = now - begin;
+    if(stallUs < static_cast<int64_t>(stallMs_)*1000 || reported_[loop] == begin)
+    {
+        return;
+    }
+
+    reported_[loop] = begin;
+    statAdd(loop->stats_.stalls_, 1);
+
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(name ? name : "", nullptr, nullptr, &status);
+    const char * type = status == 0 && demangled ? demangled : (name ? name : "-");
+    if(file)
+    {
+        LOG_WARN("loop %d(tid=%d) stalled %d ms in %s of %s, queued at %s:%d", loop->loopId(), loop->threadId(),
+                 static_cast<int>(stallUs/1000), what ? what : "-", type, file, line);
+    }
+    else
+    {
+        LOG_WARN("loop %d(tid=%d) stalled %d ms in %s of %s", loop->loopId(), loop->threadId(),
+                 static_cast<int>(stallUs/1000), what ? what : "-", type);
+    }
+    free(demangled);
+}
@@ -0,0 +1,42 @@
+#ifndef _LOOP_WATCHDOG_H_
+#define _LOOP_WATCHDOG_H_
+
+#include <stdint.h>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class EventLoop;
+
+#define DEF_STALL_MS 200
+
+/*
+   LoopWatchdog: a thread checking every live loop, a callback or functor
+   running longer than stallMs is logged once with its type and, for a
+   functor, the source location that queued it
+ */
+class LoopWatchdog
+{
+public:
+    LoopWatchdog(int stallMs = DEF_STALL_MS, int checkMs = 0);
+    ~LoopWatchdog();
+
+    void start();
+    void stop();
+private:
+    void threadFunc();
+    void checkLoop(EventLoop * loop, int64_t now);
+private:
+    int stallMs_;
+    int checkMs_; // stallMs_/2 by default
+    bool running_;
+
+    std::map<EventLoop *, int64_t> reported_; // the callback begin already logged per loop
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+#endif // _LOOP_WATCHDOG_H_
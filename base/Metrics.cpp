@@ -0,0 +1,195 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "EventLoop.h"
+#include "BaseUtil.h"
+
+namespace
+{
+
+enum
+{
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_SECONDS // a counter of microseconds, shown in seconds
+};
+
+struct MetricDesc
+{
+    const char * name_;
+    const char * help_;
+    int type_;
+    uint64_t (*get_)(EventLoop * loop);
+};
+
+#define LOOP_STAT(member) [](EventLoop * loop) { return statGet(loop->stats().member); }
+
+const MetricDesc g_metrics[] =
+{
+    { "gnet_loop_iterations_total", "Event loop iterations.", METRIC_COUNTER, LOOP_STAT(iterations_) },
+    { "gnet_loop_functors_total", "Queued functors run.", METRIC_COUNTER, LOOP_STAT(functors_) },
+    { "gnet_loop_pending_functors", "Functors waiting in the queue.", METRIC_GAUGE,
+        [](EventLoop * loop) { return static_cast<uint64_t>(loop->pendingCount()); } },
+    { "gnet_loop_max_pending_functors", "The deepest functor queue seen.", METRIC_GAUGE, LOOP_STAT(maxPending_) },
+    { "gnet_loop_callback_seconds_total", "Time spent in callbacks and functors.", METRIC_SECONDS, LOOP_STAT(callbackTime_) },
+    { "gnet_loop_poll_seconds_total", "Time spent in the loop outside callbacks.", METRIC_SECONDS, LOOP_STAT(pollTime_) },
+    { "gnet_loop_timers_fired_total", "Timer callbacks run.", METRIC_COUNTER, LOOP_STAT(timersFired_) },
+    { "gnet_loop_stalls_total", "Callbacks caught over the watchdog threshold.", METRIC_COUNTER, LOOP_STAT(stalls_) },
+    { "gnet_loop_connections", "Connected connections.", METRIC_GAUGE,
+        [](EventLoop * loop) { return static_cast<uint64_t>(loop->connCount()); } },
+    { "gnet_conn_opened_total", "Connections opened.", METRIC_COUNTER, LOOP_STAT(connOpened_) },
+    { "gnet_conn_closed_total", "Connections closed.", METRIC_COUNTER, LOOP_STAT(connClosed_) },
+    { "gnet_conn_read_bytes_total", "Bytes read from the connections.", METRIC_COUNTER, LOOP_STAT(bytesIn_) },
+    { "gnet_conn_written_bytes_total", "Bytes written to the connections.", METRIC_COUNTER, LOOP_STAT(bytesOut_) },
+    { "gnet_conn_reads_total", "Read callbacks of the connections.", METRIC_COUNTER, LOOP_STAT(reads_) },
+    { "gnet_conn_writes_total", "Writes to the connections.", METRIC_COUNTER, LOOP_STAT(writes_) },
+};
+
+#undef LOOP_STAT
+
+struct HistogramDesc
+{
+    const char * name_;
+    const char * help_;
+    const LatencyHistogram & (*get_)(EventLoop * loop);
+};
+
+const HistogramDesc g_histograms[] =
+{
+    { "gnet_loop_callback_latency_seconds", "Duration of the callbacks and functors.",
+        [](EventLoop * loop) -> const LatencyHistogram & { return loop->stats().callbackLatency_; } },
+    { "gnet_loop_queue_latency_seconds", "Delay of the functors from queueInLoop to running.",
+        [](EventLoop * loop) -> const LatencyHistogram & { return loop->stats().queueLatency_; } },
+};
+
+const double g_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    uint64_t total = 0;
+    uint64_t counts[NUM_BUCKETS];
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+        counts[i] = statGet(buckets_[i]);
+        total += counts[i];
+    }
+
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q*total + 0.5);
+    rank = rank > 0 ? rank : 1;
+
+    uint64_t seen = 0;
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+        seen += counts[i];
+        if(seen >= rank)
+        {
+            uint64_t upper = i + 1 < NUM_BUCKETS ? lowerBound(i + 1) - 1 : UINT64_MAX;
+            return MIN_VALUE(upper, max());
+        }
+    }
+
+    return max();
+}
+
+MetricsRegistry & MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+void MetricsRegistry::addLoop(EventLoop * loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    loops_.insert(loop);
+}
+
+void MetricsRegistry::delLoop(EventLoop * loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    loops_.erase(loop);
+}
+
+//the lock only keeps the loops alive, the counters are read without it
+void MetricsRegistry::scrape(std::string & out)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    char line[256];
+    for(size_t i = 0; i < sizeof(g_metrics)/sizeof(g_metrics[0]); ++i)
+    {
+        const MetricDesc & desc = g_metrics[i];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", desc.name_, desc.help_,
+                 desc.name_, desc.type_ == METRIC_GAUGE ? "gauge" : "counter");
+        out.append(line);
+
+        for(auto it = loops_.begin(); it != loops_.end(); ++it)
+        {
+            EventLoop * loop = *it;
+            uint64_t value = desc.get_(loop);
+            if(desc.type_ == METRIC_SECONDS)
+            {
+                snprintf(line, sizeof(line), "%s{loop=\"%d\",tid=\"%d\"} %.6f\n", desc.name_, loop->loopId(), loop->threadId(),
+                         static_cast<double>(value)/1000000);
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "%s{loop=\"%d\",tid=\"%d\"} %llu\n", desc.name_, loop->loopId(), loop->threadId(),
+                         static_cast<unsigned long long>(value));
+            }
+            out.append(line);
+        }
+    }
+
+    for(size_t i = 0; i < sizeof(g_histograms)/sizeof(g_histograms[0]); ++i)
+    {
+        const HistogramDesc & desc = g_histograms[i];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s summary\n", desc.name_, desc.help_, desc.name_);
+        out.append(line);
+
+        for(auto it = loops_.begin(); it != loops_.end(); ++it)
+        {
+            EventLoop * loop = *it;
+            const LatencyHistogram & histogram = desc.get_(loop);
+            for(size_t j = 0; j < sizeof(g_quantiles)/sizeof(g_quantiles[0]); ++j)
+            {
+                snprintf(line, sizeof(line), "%s{loop=\"%d\",tid=\"%d\",quantile=\"%g\"} %.6f\n", desc.name_, loop->loopId(), loop->threadId(),
+                         g_quantiles[j], static_cast<double>(histogram.quantile(g_quantiles[j]))/1000000);
+                out.append(line);
+            }
+
+            snprintf(line, sizeof(line), "%s_sum{loop=\"%d\",tid=\"%d\"} %.6f\n%s_count{loop=\"%d\",tid=\"%d\"} %llu\n",
+                     desc.name_, loop->loopId(), loop->threadId(), static_cast<double>(histogram.sum())/1000000,
+                     desc.name_, loop->loopId(), loop->threadId(), static_cast<unsigned long long>(histogram.count()));
+            out.append(line);
+        }
+    }
+
+    for(size_t i = 0; i < scrapers_.size(); ++i)
+    {
+        scrapers_[i](out);
+    }
+}
+
+void MetricsRegistry::forEachLoop(const std::function<void (EventLoop *)> & fn)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(auto it = loops_.begin(); it != loops_.end(); ++it)
+    {
+        fn(*it);
+    }
+}
+
+void MetricsRegistry::addScraper(const std::function<void (std::string &)> & fn)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    scrapers_.push_back(fn);
+}
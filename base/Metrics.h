@@ -0,0 +1,171 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <functional>
+
+class EventLoop;
+
+/*
+   the counters have a single writer, the loop thread that owns them, so they
+   are bumped with a relaxed load and store instead of a locked add; any thread
+   can read them, the registry aggregates them only when scraped
+ */
+inline void statAdd(std::atomic<uint64_t> & stat, uint64_t n)
+{
+    stat.store(stat.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void statMax(std::atomic<uint64_t> & stat, uint64_t n)
+{
+    if(n > stat.load(std::memory_order_relaxed))
+    {
+        stat.store(n, std::memory_order_relaxed);
+    }
+}
+
+inline uint64_t statGet(const std::atomic<uint64_t> & stat)
+{
+    return stat.load(std::memory_order_relaxed);
+}
+
+/*
+   LatencyHistogram: log-linear buckets of microseconds(HDR style), exact
+   below 16us, then 8 buckets per power of two, so within 12.5% up to 2^64
+ */
+class LatencyHistogram
+{
+public:
+    enum
+    {
+        SUB_BITS = 3,
+        SUB_COUNT = 1 << SUB_BITS,
+        LINEAR_COUNT = 2 << SUB_BITS,
+        NUM_BUCKETS = LINEAR_COUNT + (64 - SUB_BITS - 1)*SUB_COUNT
+    };
+
+    LatencyHistogram():count_(0), sum_(0), max_(0)
+    {
+        for(int i = 0; i < NUM_BUCKETS; ++i)
+        {
+            buckets_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    //single writer, like the counters
+    void record(int64_t us)
+    {
+        uint64_t v = us > 0 ? static_cast<uint64_t>(us) : 0;
+        statAdd(buckets_[index(v)], 1);
+        statAdd(count_, 1);
+        statAdd(sum_, v);
+        statMax(max_, v);
+    }
+
+    uint64_t count() const { return statGet(count_); }
+    uint64_t sum() const { return statGet(sum_); }
+    uint64_t max() const { return statGet(max_); }
+
+    //the upper bound of the bucket holding the q quantile, q in [0, 1]
+    uint64_t quantile(double q) const;
+
+    static int index(uint64_t v)
+    {
+        if(v < LINEAR_COUNT)
+        {
+            return static_cast<int>(v);
+        }
+
+        int p = 63 - __builtin_clzll(v);
+        return LINEAR_COUNT + (p - SUB_BITS - 1)*SUB_COUNT + static_cast<int>((v >> (p - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    static uint64_t lowerBound(int index)
+    {
+        if(index < LINEAR_COUNT)
+        {
+            return static_cast<uint64_t>(index);
+        }
+
+        int p = (index - LINEAR_COUNT)/SUB_COUNT + SUB_BITS + 1;
+        uint64_t sub = static_cast<uint64_t>((index - LINEAR_COUNT)%SUB_COUNT);
+        return (SUB_COUNT + sub) << (p - SUB_BITS);
+    }
+private:
+    std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+//the counters of one BaseConn
+struct ConnStats
+{
+    ConnStats():bytesIn_(0), bytesOut_(0), reads_(0), writes_(0), connectTime_(0), closeTime_(0) {}
+
+    std::atomic<uint64_t> bytesIn_; // the bytes read from the socket
+    std::atomic<uint64_t> bytesOut_; // the bytes queued to the socket
+    std::atomic<uint64_t> reads_; // the read callbacks
+    std::atomic<uint64_t> writes_; // the write calls
+    std::atomic<uint64_t> connectTime_; // microseconds since the epoch, 0 if not yet
+    std::atomic<uint64_t> closeTime_;
+};
+
+//the counters of one EventLoop, the conn counters sum the conns of the loop
+struct LoopStats
+{
+    LoopStats():iterations_(0), functors_(0), maxPending_(0), callbackTime_(0), pollTime_(0), timersFired_(0), stalls_(0),
+        connOpened_(0), connClosed_(0), bytesIn_(0), bytesOut_(0), reads_(0), writes_(0) {}
+
+    std::atomic<uint64_t> iterations_;
+    std::atomic<uint64_t> functors_; // the queued functors run
+    std::atomic<uint64_t> maxPending_; // the deepest functor queue seen
+    std::atomic<uint64_t> callbackTime_; // microseconds in the callbacks and functors
+    std::atomic<uint64_t> pollTime_; // microseconds in the loop outside them
+    std::atomic<uint64_t> timersFired_;
+    std::atomic<uint64_t> stalls_; // written by the LoopWatchdog thread
+
+    LatencyHistogram callbackLatency_; // the duration of every callback and functor
+    LatencyHistogram queueLatency_; // a functor from queueInLoop to running
+
+    std::atomic<uint64_t> connOpened_;
+    std::atomic<uint64_t> connClosed_;
+    std::atomic<uint64_t> bytesIn_;
+    std::atomic<uint64_t> bytesOut_;
+    std::atomic<uint64_t> reads_;
+    std::atomic<uint64_t> writes_;
+};
+
+/*
+   MetricsRegistry: the live loops, scraped into the Prometheus text format
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry & instance();
+
+    void addLoop(EventLoop * loop);
+    void delLoop(EventLoop * loop);
+
+    //append the metrics of all the loops to out
+    void scrape(std::string & out);
+
+    //call fn for every live loop, the loops can't be freed meanwhile
+    void forEachLoop(const std::function<void (EventLoop *)> & fn);
+
+    //fn appends its metrics to every scrape, for the modules outside the loops
+    void addScraper(const std::function<void (std::string &)> & fn);
+private:
+    MetricsRegistry() {}
+
+    std::mutex mutex_;
+    std::set<EventLoop *> loops_;
+    std::vector<std::function<void (std::string &)> > scrapers_;
+};
+
+#endif // _METRICS_H_
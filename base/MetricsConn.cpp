@@ -0,0 +1,57 @@
+#include "MetricsConn.h"
+
+#include <stdio.h>
+
+#include "BaseUtil.h"
+#include "Metrics.h"
+
+#define MAX_METRICS_REQUEST 8192
+
+void MetricsConn::onRead()
+{
+    std::vector<char> data;
+    if(!read(data))
+    {
+        return;
+    }
+
+    request_.append(data.data(), data.size());
+    if(request_.size() > MAX_METRICS_REQUEST)
+    {
+        close();
+        return;
+    }
+
+    if(request_.find("\r\n\r\n") == std::string::npos && request_.find("\n\n") == std::string::npos)
+    {
+        //the header not complete
+        return;
+    }
+
+    if(request_.compare(0, 13, "GET /metrics ") == 0 || request_.compare(0, 6, "GET / ") == 0)
+    {
+        std::string body;
+        MetricsRegistry::instance().scrape(body);
+        respond("200 OK", body);
+    }
+    else
+    {
+        respond("404 Not Found", "not found\n");
+    }
+}
+
+void MetricsConn::respond(const char * status, const std::string & body)
+{
+    char header[256];
+    int headerLen = snprintf(header, sizeof(header),
+                             "HTTP/1.0 %s\r\n"
+                             "Content-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: %d\r\n"
+                             "Connection: close\r\n\r\n", status, static_cast<int>(body.size()));
+
+    write(header, headerLen, const_cast<char *>(body.data()), body.size());
+
+    //close once the response is flushed
+    BaseConnPtr self = shared_from_this();
+    setDrainWaiter(0, [self]{ self->close(); });
+}
@@ -0,0 +1,24 @@
+#ifndef _METRICS_CONN_H_
+#define _METRICS_CONN_H_
+
+#include <string>
+
+#include "BaseConn.h"
+
+/*
+   MetricsConn: a minimal HTTP/1.0 responder, GET /metrics returns the
+   MetricsRegistry in the Prometheus text format, then the conn closes
+ */
+class MetricsConn:public BaseConn
+{
+public:
+    MetricsConn(EventLoop * loop):BaseConn(loop) {}
+protected:
+    virtual void onRead();
+private:
+    void respond(const char * status, const std::string & body);
+
+    std::string request_;
+};
+
+#endif // _METRICS_CONN_H_
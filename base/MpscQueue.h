@@ -0,0 +1,179 @@
+#ifndef _MPSC_QUEUE_H_
+#define _MPSC_QUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+/*
+   MpscQueue: lock-free multi-producer/single-consumer fifo queue
+
+   push() may be called from any thread, pop() only from the consumer thread.
+   A producer swaps itself into head_ and then links the previous node, so a
+   pop() can transiently see the queue as empty while a push is half done;
+   callers must pair the queue with their own wakeup counter, counted after
+   the push, and drain it with popCounted().
+
+   The nodes are recycled, so a push allocates only while the queue warms up:
+   the consumer gathers the nodes it is done with in batches of CacheBatch,
+   a producer takes a whole batch into a cache of its thread, the lock of the
+   batches is taken once per CacheBatch pushes and pops. The queue keeps the
+   nodes of its peak until it is destroyed. T must be move assignable, a
+   recycled node keeps the moved-from value.
+ */
+template<typename T>
+class MpscQueue
+{
+public:
+    static const size_t CacheBatch = 64; // the free nodes moved at once
+
+    MpscQueue():
+        head_(new Node),
+        tail_(head_.load(std::memory_order_relaxed)),
+        free_(nullptr),
+        sizeFree_(0)
+    {}
+
+    ~MpscQueue()
+    {
+        T value;
+        while(pop(value))
+        {
+        }
+
+        delete tail_;
+        deleteList(free_);
+        for(size_t i = 0; i < batches_.size(); ++i)
+        {
+            deleteList(batches_[i]);
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue & operator=(const MpscQueue &) = delete;
+
+    void push(T && value)
+    {
+        Node * node = takeNode();
+        node->value_ = std::move(value);
+        node->next_.store(nullptr, std::memory_order_relaxed);
+        Node * prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next_.store(node, std::memory_order_release);
+    }
+
+    bool pop(T & value)
+    {
+        Node * next = tail_->next_.load(std::memory_order_acquire);
+        if(next == nullptr)
+        {
+            return false;
+        }
+
+        value = std::move(next->value_);
+        recycle(tail_);
+        tail_ = next;
+        return true;
+    }
+
+    //pop the count values the producers counted after their push, into fn;
+    //a counted value can sit behind a push still half done, the count of the
+    //values not reached goes back to counter. true if counter was zero, no
+    //producer wakes the consumer then, it has to wake itself
+    template<typename Fn>
+    bool popCounted(std::atomic<size_t> & counter, size_t count, Fn && fn)
+    {
+        T value;
+        size_t i = 0;
+        for(; i < count && pop(value); ++i)
+        {
+            fn(value);
+        }
+
+        if(i == count)
+        {
+            return false;
+        }
+
+        return counter.fetch_add(count - i, std::memory_order_acq_rel) == 0;
+    }
+
+    bool empty() const
+    {
+        return tail_->next_.load(std::memory_order_acquire) == nullptr;
+    }
+private:
+    struct Node
+    {
+        Node():next_(nullptr) {}
+
+        std::atomic<Node *> next_; // the queue link, or the free list link
+        T value_;
+    };
+
+    //the free nodes a thread took from the queues of this T, only it touches them
+    struct NodeCache
+    {
+        NodeCache():head_(nullptr) {}
+        ~NodeCache() { deleteList(head_); }
+
+        Node * head_;
+    };
+
+    static void deleteList(Node * node)
+    {
+        while(node)
+        {
+            Node * next = node->next_.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    Node * takeNode()
+    {
+        static thread_local NodeCache cache;
+        if(!cache.head_)
+        {
+            std::unique_lock<std::mutex> lock(batchMutex_);
+            if(batches_.empty())
+            {
+                return new Node;
+            }
+
+            cache.head_ = batches_.back();
+            batches_.pop_back();
+        }
+
+        Node * node = cache.head_;
+        cache.head_ = node->next_.load(std::memory_order_relaxed);
+        return node;
+    }
+
+    //the producer that linked node is done with it once the consumer moved past it
+    void recycle(Node * node)
+    {
+        node->next_.store(free_, std::memory_order_relaxed);
+        free_ = node;
+        if(++sizeFree_ < CacheBatch)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(batchMutex_);
+        batches_.push_back(free_);
+        free_ = nullptr;
+        sizeFree_ = 0;
+    }
+
+    std::atomic<Node *> head_; // the producer side
+    Node * tail_; // the consumer side, tail_ is the stub
+    Node * free_; // the batch the consumer is filling
+    size_t sizeFree_;
+
+    std::mutex batchMutex_;
+    std::vector<Node *> batches_; // the full batches, for the producers
+};
+
+#endif // _MPSC_QUEUE_H_
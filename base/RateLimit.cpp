@@ -0,0 +1,129 @@
+#include "RateLimit.h"
+
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+
+#include "BaseUtil.h"
+#include "EventLoop.h"
+
+//the bucket size of a rate per tick, 0 is unlimited
+static size_t perTick(size_t rate, int tickMs)
+{
+    if(rate == 0)
+    {
+        return EV_RATE_LIMIT_MAX;
+    }
+
+    size_t n = rate*tickMs/1000;
+    return n > 0 ? n : 1;
+}
+
+static size_t burstOf(size_t rate, size_t burst, size_t tickRate)
+{
+    if(rate == 0)
+    {
+        return EV_RATE_LIMIT_MAX;
+    }
+
+    //the bucket must hold at least one refill
+    burst = burst > 0 ? burst : rate;
+    return MAX_VALUE(burst, tickRate);
+}
+
+RateLimit::RateLimit(size_t readRate, size_t writeRate, size_t readBurst, size_t writeBurst, int tickMs):
+    cfg_(nullptr),
+    readThrottled_(0),
+    writeThrottled_(0)
+{
+    tickMs = tickMs > 0 ? tickMs : RATE_LIMIT_TICK_MS;
+    size_t readTick = perTick(readRate, tickMs);
+    size_t writeTick = perTick(writeRate, tickMs);
+
+    struct timeval tick = {tickMs/1000, (tickMs%1000)*1000};
+    cfg_ = ev_token_bucket_cfg_new(readTick, burstOf(readRate, readBurst, readTick),
+                                   writeTick, burstOf(writeRate, writeBurst, writeTick), &tick);
+    ASSERT_ABORT(cfg_);
+}
+
+RateLimit::~RateLimit()
+{
+    ev_token_bucket_cfg_free(cfg_);
+}
+
+RateLimitGroup::RateLimitGroup(size_t readRate, size_t writeRate, size_t readBurst, size_t writeBurst, int tickMs):
+    limit_(readRate, writeRate, readBurst, writeBurst, tickMs)
+{
+}
+
+RateLimitGroup::~RateLimitGroup()
+{
+    for(auto it = groups_.begin(); it != groups_.end(); ++it)
+    {
+        bufferevent_rate_limit_group_free(it->second);
+    }
+}
+
+struct bufferevent_rate_limit_group * RateLimitGroup::getGroup(EventLoop * loop)
+{
+    loop->assertInLoopThread();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = groups_.find(loop);
+    if(it != groups_.end())
+    {
+        return it->second;
+    }
+
+    struct bufferevent_rate_limit_group * group = bufferevent_rate_limit_group_new(loop->get_event(), limit_.cfg());
+    ASSERT_ABORT(group);
+    groups_.insert(std::make_pair(loop, group));
+    return group;
+}
+
+void RateLimitGroup::getTotals(uint64_t & totalRead, uint64_t & totalWritten)
+{
+    totalRead = 0;
+    totalWritten = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(auto it = groups_.begin(); it != groups_.end(); ++it)
+    {
+        ev_uint64_t r = 0;
+        ev_uint64_t w = 0;
+        bufferevent_rate_limit_group_get_totals(it->second, &r, &w);
+        totalRead += r;
+        totalWritten += w;
+    }
+}
+
+static std::mutex & typeMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::map<int, RateLimitGroupPtr> & typeGroups()
+{
+    static std::map<int, RateLimitGroupPtr> groups;
+    return groups;
+}
+
+void RateLimitGroup::setTypeGroup(int type, const RateLimitGroupPtr & group)
+{
+    std::unique_lock<std::mutex> lock(typeMutex());
+    if(group)
+    {
+        typeGroups()[type] = group;
+    }
+    else
+    {
+        typeGroups().erase(type);
+    }
+}
+
+RateLimitGroupPtr RateLimitGroup::getTypeGroup(int type)
+{
+    std::unique_lock<std::mutex> lock(typeMutex());
+    auto it = typeGroups().find(type);
+    return it != typeGroups().end() ? it->second : RateLimitGroupPtr();
+}
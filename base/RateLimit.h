@@ -0,0 +1,93 @@
+#ifndef _RATE_LIMIT_H_
+#define _RATE_LIMIT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+class EventLoop;
+class RateLimit;
+class RateLimitGroup;
+
+typedef std::shared_ptr<RateLimit> RateLimitPtr;
+typedef std::shared_ptr<RateLimitGroup> RateLimitGroupPtr;
+
+#define RATE_LIMIT_TICK_MS 100
+
+/*
+   RateLimit: token bucket limits of the bytes read and written, built on the
+   libevent bufferevent rate limiting, the buckets refill every tick
+
+   the rates are bytes per second, 0 means unlimited; the burst is the bucket
+   size, the rate of one second if 0. every connection using a RateLimit owns
+   its buckets, the config and the counters are shared.
+
+   readThrottled: the read events that emptied the read bucket, reading is
+   suspended until the next refill after each of them
+   writeThrottled: the writes queued while the write bucket was empty
+ */
+class RateLimit
+{
+public:
+    RateLimit(size_t readRate, size_t writeRate, size_t readBurst = 0, size_t writeBurst = 0, int tickMs = RATE_LIMIT_TICK_MS);
+    ~RateLimit();
+
+    struct ev_token_bucket_cfg * cfg() const { return cfg_; }
+
+    uint64_t readThrottled() const { return readThrottled_.load(std::memory_order_relaxed); }
+    uint64_t writeThrottled() const { return writeThrottled_.load(std::memory_order_relaxed); }
+
+    void addReadThrottled() { readThrottled_.fetch_add(1, std::memory_order_relaxed); }
+    void addWriteThrottled() { writeThrottled_.fetch_add(1, std::memory_order_relaxed); }
+private:
+    RateLimit(const RateLimit &);
+    RateLimit & operator=(const RateLimit &);
+
+    struct ev_token_bucket_cfg * cfg_;
+    std::atomic<uint64_t> readThrottled_;
+    std::atomic<uint64_t> writeThrottled_;
+};
+
+/*
+   RateLimitGroup: one pair of buckets shared by all the member connections,
+   for a listener or a ConnInfo::type()
+
+   a libevent group must stay on one event base, so the group keeps one set of
+   buckets per EventLoop: a group used by N loops lets N times the rate pass,
+   divide the rate by the loop count for a global cap. the group must outlive
+   its member connections and be freed before the loops.
+ */
+class RateLimitGroup
+{
+public:
+    RateLimitGroup(size_t readRate, size_t writeRate, size_t readBurst = 0, size_t writeBurst = 0, int tickMs = RATE_LIMIT_TICK_MS);
+    ~RateLimitGroup();
+
+    //the buckets of loop, created on the first use, call it in the loop thread
+    struct bufferevent_rate_limit_group * getGroup(EventLoop * loop);
+
+    uint64_t readThrottled() const { return limit_.readThrottled(); }
+    uint64_t writeThrottled() const { return limit_.writeThrottled(); }
+
+    void addReadThrottled() { limit_.addReadThrottled(); }
+    void addWriteThrottled() { limit_.addWriteThrottled(); }
+
+    //the bytes passed through the group on all the loops
+    void getTotals(uint64_t & totalRead, uint64_t & totalWritten);
+
+    //the group joined by the connections of a ConnInfo::type(), null to remove it
+    static void setTypeGroup(int type, const RateLimitGroupPtr & group);
+    static RateLimitGroupPtr getTypeGroup(int type);
+private:
+    RateLimitGroup(const RateLimitGroup &);
+    RateLimitGroup & operator=(const RateLimitGroup &);
+
+    RateLimit limit_;
+    std::mutex mutex_;
+    std::map<EventLoop *, struct bufferevent_rate_limit_group *> groups_;
+};
+
+#endif // _RATE_LIMIT_H_
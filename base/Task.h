@@ -0,0 +1,146 @@
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include <stddef.h>
+#include <new>
+#include <typeinfo>
+#include <utility>
+#include <type_traits>
+
+/*
+   Task: move-only void() callable with inline storage
+
+   Callables up to InlineSize bytes (e.g. std::bind of a member function with
+   two shared_ptr) are stored in place, the Task itself does no allocation;
+   queueInLoop then allocates only while the MpscQueue warms up its nodes
+   (~0.001 per task in benchmark/TaskBench). Larger callables fall back to
+   the heap.
+ */
+class Task
+{
+public:
+    static const size_t InlineSize = 48;
+
+    Task():ops_(nullptr) {}
+    Task(std::nullptr_t):ops_(nullptr) {}
+
+    template<typename F,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F && f):ops_(nullptr)
+    {
+        typedef typename std::decay<F>::type Fn;
+        init<Fn>(std::forward<F>(f), FitsInline<Fn>());
+    }
+
+    Task(Task && other):ops_(other.ops_)
+    {
+        if(ops_)
+        {
+            ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Task & operator=(Task && other)
+    {
+        if(this != &other)
+        {
+            reset();
+            ops_ = other.ops_;
+            if(ops_)
+            {
+                ops_->move(&storage_, &other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task & operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops_->invoke(&storage_); }
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void reset()
+    {
+        if(ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    //true if the callable is kept in the inline storage
+    bool isInline() const { return ops_ && ops_->inlined; }
+
+    //the mangled type name of the callable, for diagnostics
+    const char * name() const { return ops_ ? ops_->name() : ""; }
+private:
+    typedef typename std::aligned_storage<InlineSize, alignof(void *) * 2>::type Storage;
+
+    struct Ops
+    {
+        void (*invoke)(void * p);
+        void (*move)(void * dst, void * src);
+        void (*destroy)(void * p);
+        const char * (*name)();
+        bool inlined;
+    };
+
+    template<typename Fn>
+    struct FitsInline:std::integral_constant<bool,
+        sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(Storage) && std::is_nothrow_move_constructible<Fn>::value>
+    {};
+
+    template<typename Fn, typename F>
+    void init(F && f, std::true_type)
+    {
+        ::new(static_cast<void *>(&storage_)) Fn(std::forward<F>(f));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    template<typename Fn, typename F>
+    void init(F && f, std::false_type)
+    {
+        *reinterpret_cast<Fn **>(&storage_) = new Fn(std::forward<F>(f));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    template<typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void * p) { (*static_cast<Fn *>(p))(); }
+        static void move(void * dst, void * src)
+        {
+            ::new(dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        }
+        static void destroy(void * p) { static_cast<Fn *>(p)->~Fn(); }
+        static const char * name() { return typeid(Fn).name(); }
+        static const Ops ops;
+    };
+
+    template<typename Fn>
+    struct HeapOps
+    {
+        static void invoke(void * p) { (**static_cast<Fn **>(p))(); }
+        static void move(void * dst, void * src) { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); }
+        static void destroy(void * p) { delete *static_cast<Fn **>(p); }
+        static const char * name() { return typeid(Fn).name(); }
+        static const Ops ops;
+    };
+
+    Storage storage_;
+    const Ops * ops_;
+};
+
+template<typename Fn>
+const Task::Ops Task::InlineOps<Fn>::ops = { &Task::InlineOps<Fn>::invoke, &Task::InlineOps<Fn>::move, &Task::InlineOps<Fn>::destroy, &Task::InlineOps<Fn>::name, true };
+
+template<typename Fn>
+const Task::Ops Task::HeapOps<Fn>::ops = { &Task::HeapOps<Fn>::invoke, &Task::HeapOps<Fn>::move, &Task::HeapOps<Fn>::destroy, &Task::HeapOps<Fn>::name, false };
+
+#endif // _TASK_H_
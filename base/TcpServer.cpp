@@ -2,26 +2,94 @@
 
 #include <assert.h>
 #include <event2/listener.h>
+#include <event2/util.h>
 
 #include "BaseUtil.h"
+#include "MetricsConn.h"
 
-TcpServer::TcpServer(EventLoop * loop):
+TcpServer::TcpServer(EventLoop * loop, EventLoopThreadPool * pool):
     loop_(loop),
+    pool_(pool),
     listener_(nullptr)
 {
     assert(loop_ != nullptr);
 }
 
+//the listeners call back into the server, they go with it; libevent isn't
+//thread safe here, so the loops must have quit or this runs in the only loop
 TcpServer::~TcpServer()
 {
+    for(auto it = listeners_.begin(); it != listeners_.end(); ++it)
+    {
+        if(it->second)
+        {
+            evconnlistener_free(it->second);
+        }
+    }
+
+    for(auto it = shards_.begin(); it != shards_.end(); ++it)
+    {
+        for(size_t i = 0; i < it->second.size(); ++i)
+        {
+            delShardInLoop(it->second[i]);
+        }
+    }
+}
+
+void TcpServer::addMetricsServer(ConnInfo & ci)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connList_.insert(ci);
+    }
+    loop_->runInLoop(std::bind(&TcpServer::addMetricsInLoop, this, ci));
+}
+
+void TcpServer::addMetricsInLoop(ConnInfo & ci)
+{
+    struct evconnlistener * listener = listeners_[ci];
+    if(!listener)
+    {
+        sockaddr_storage sockAddr;
+        int sockLen = base::makeAddr(ci.getCurrAddrInfo(), sockAddr);
+
+        listeners_[ci] = createServer(loop_->get_event(), onMetricsAccept, this, (const sockaddr *)&sockAddr, sockLen);
+    }
+}
+
+void TcpServer::onMetricsAccept(struct evconnlistener *,
+                    int sockfd,
+                    struct sockaddr * sockAddr,
+                    int sockLen,
+                    void * arg)
+{
+    ConnInfo ci(sockfd);
+    ci.addAddrInfo(base::getAddr(sockAddr, sockLen));
+    TcpServer * server = static_cast<TcpServer *>(arg);
+    server->onAccept<MetricsConn>(server->loop_, nullptr, ci);
 }
 
 void TcpServer::delServer(ConnInfo & ci)
 {
+    std::vector<Shard *> shards;
     {
         std::unique_lock<std::mutex> lock(mutex_);
         connList_.erase(ci);
+
+        auto it = shards_.find(ci);
+        if(it != shards_.end())
+        {
+            shards.swap(it->second);
+            shards_.erase(it);
+        }
+    }
+
+    //the listener is freed in the loop it was created
+    for(size_t i = 0; i < shards.size(); ++i)
+    {
+        shards[i]->loop_->runInLoop(std::bind(&TcpServer::delShardInLoop, shards[i]));
     }
+
     loop_->runInLoop(std::bind(&TcpServer::delServerInLoop, this, ci));
 }
 
@@ -33,12 +101,23 @@ void TcpServer::delServerInLoop(ConnInfo & ci)
         struct evconnlistener * listener = it->second;
         if(listener)
         {
-            evconnlistener_free(listener_);
+            listenLimits_.erase(listener);
+            evconnlistener_free(listener);
             listeners_.erase(it);
         }
     }
 }
 
+void TcpServer::delShardInLoop(Shard * shard)
+{
+    if(shard->listener_)
+    {
+        evconnlistener_free(shard->listener_);
+    }
+
+    delete shard;
+}
+
 void TcpServer::getConnInfo(std::vector<ConnInfo> & connList)
 {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -48,6 +127,12 @@ void TcpServer::getConnInfo(std::vector<ConnInfo> & connList)
     }
 }
 
+void TcpServer::setConnRateLimit(const BaseConnPtr & pConn, const ListenLimit * limit)
+{
+    pConn->setRateLimit(limit && limit->limit_ ? limit->limit_ : rateLimit_);
+    pConn->setRateLimitGroup(limit && limit->group_ ? limit->group_ : rateLimitGroup_);
+}
+
 void TcpServer::onConnect(const BaseConnPtr &)
 {
     //LOG_TRACE("TcpServer::onConnect:%p", pConn.get());
@@ -68,3 +153,31 @@ evconnlistener * TcpServer::createServer(struct event_base *base, evconnlistener
 {
     return evconnlistener_new_bind(base, cb, ptr, LEV_OPT_REUSEABLE|LEV_OPT_CLOSE_ON_FREE, -1, sa, socklen);
 }
+
+evconnlistener * TcpServer::createReusePortServer(struct event_base *base, evconnlistener_cb cb, void *ptr, const struct sockaddr *sa, int socklen)
+{
+    int fd = ::socket(sa->sa_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        LOG_ERROR("socket errno=%d, error:%s", errno, strerror(errno));
+        return nullptr;
+    }
+
+    base::setReuseAddr(fd, true);
+    base::setReusePort(fd, true);
+    if(::bind(fd, sa, socklen) != 0)
+    {
+        LOG_ERROR("bind errno=%d, error:%s", errno, strerror(errno));
+        evutil_closesocket(fd);
+        return nullptr;
+    }
+
+    evconnlistener * listener = evconnlistener_new(base, cb, ptr, LEV_OPT_CLOSE_ON_FREE, -1, fd);
+    if(!listener)
+    {
+        LOG_ERROR("evconnlistener_new errno=%d, error:%s", errno, strerror(errno));
+        evutil_closesocket(fd);
+    }
+
+    return listener;
+}
@@ -12,6 +12,7 @@
 #include "SocketOps.h"
 #include "BaseConn.h"
 #include "EventLoop.h"
+#include "EventLoopThreadPool.h"
 
 class TcpServer;
 typedef std::shared_ptr<TcpServer> TcpServerPtr;
@@ -23,25 +24,99 @@ public:
     typedef void (*evconnlistener_cb)(struct evconnlistener *, int, struct sockaddr *, int socklen, void *);
     typedef std::map<ConnInfo, struct evconnlistener *> ListenMap_t;
 
-    TcpServer(EventLoop * loop);
-    ~TcpServer();
+    //the limits of the connections of one listener, those of the server if null
+    struct ListenLimit
+    {
+        RateLimitPtr      limit_;
+        RateLimitGroupPtr group_;
+    };
+    typedef std::map<struct evconnlistener *, ListenLimit> ListenLimitMap_t;
+
+    //one SO_REUSEPORT listener of a worker loop
+    struct Shard
+    {
+        TcpServer *              server_;
+        EventLoop *              loop_;
+        struct evconnlistener * listener_;
+        ListenLimit              limit_;
+    };
+    typedef std::map<ConnInfo, std::vector<Shard *> > ShardMap_t;
 
+    TcpServer(EventLoop * loop, EventLoopThreadPool * pool = nullptr);
+    ~TcpServer(); // after the loops quit, it frees the listeners
+
+    //limit and group apply to the connections of this listener only, see setRateLimit()
     template<typename T>
-    void addServer(ConnInfo & ci)
+    void addServer(ConnInfo & ci, const RateLimitPtr & limit = RateLimitPtr(), const RateLimitGroupPtr & group = RateLimitGroupPtr())
     {
         {
             std::unique_lock<std::mutex> lock(mutex_);
             connList_.insert(ci);
         }
-        loop_->runInLoop(std::bind(&TcpServer::addServerInLoop<T>, this, ci));
+
+        ListenLimit listenLimit = { limit, group };
+        loop_->runInLoop(std::bind(&TcpServer::addServerInLoop<T>, this, ci, listenLimit));
     }
 
+    /*
+      listen on every loop of the pool with SO_REUSEPORT, the kernel balances
+      the accepts and a connection is born on the loop that accepted it
+
+      T must be constructible from the accepting EventLoop *, limit and group
+      as for addServer(), a group keeps one set of buckets per loop
+    */
+    template<typename T>
+    void addShardServer(ConnInfo & ci, const RateLimitPtr & limit = RateLimitPtr(), const RateLimitGroupPtr & group = RateLimitGroupPtr())
+    {
+        std::vector<EventLoop *> loops;
+        if(pool_)
+        {
+            loops = pool_->getAllLoops();
+        }
+
+        if(loops.empty())
+        {
+            loops.push_back(loop_);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            connList_.insert(ci);
+            for(size_t i = 0; i < loops.size(); ++i)
+            {
+                Shard * shard = new Shard;
+                shard->server_ = this;
+                shard->loop_ = loops[i];
+                shard->listener_ = nullptr;
+                shard->limit_.limit_ = limit;
+                shard->limit_.group_ = group;
+                shards_[ci].push_back(shard);
+            }
+        }
+
+        for(size_t i = 0; i < loops.size(); ++i)
+        {
+            loops[i]->runInLoop(std::bind(&TcpServer::addShardInLoop<T>, this, loops[i], ci));
+        }
+    }
+
+    //serve the metrics of all the loops on the server loop, GET /metrics
+    void addMetricsServer(ConnInfo & ci);
+
     void delServer(ConnInfo & ci);
 
+    //the limits of the connections of the listeners without their own, set them
+    //before adding the servers: limit gives each connection its own buckets,
+    //group is shared by all of them
+    void setRateLimit(const RateLimitPtr & limit) { rateLimit_ = limit; }
+    void setRateLimitGroup(const RateLimitGroupPtr & group) { rateLimitGroup_ = group; }
+    const RateLimitPtr & getRateLimit() const { return rateLimit_; }
+    const RateLimitGroupPtr & getRateLimitGroup() const { return rateLimitGroup_; }
+
     void getConnInfo(std::vector<ConnInfo> & connList);
 private:
     template<typename T>
-    void addServerInLoop(ConnInfo & ci)
+    void addServerInLoop(ConnInfo & ci, const ListenLimit & limit)
     {
         struct evconnlistener * listener = listeners_[ci];
         if(!listener)
@@ -49,16 +124,50 @@ private:
             sockaddr_storage sockAddr;
             int sockLen = base::makeAddr(ci.getCurrAddrInfo(), sockAddr);
 
-            listeners_[ci] = createServer(loop_->get_event(), onAccept<T>, this, (const sockaddr *)&sockAddr, sockLen);
+            listener = createServer(loop_->get_event(), onAccept<T>, this, (const sockaddr *)&sockAddr, sockLen);
+            listeners_[ci] = listener;
+            if(listener)
+            {
+                listenLimits_[listener] = limit;
+            }
         }
     }
 
+    template<typename T>
+    void addShardInLoop(EventLoop * loop, ConnInfo & ci)
+    {
+        Shard * shard = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = shards_.find(ci);
+            for(size_t i = 0; it != shards_.end() && i < it->second.size(); ++i)
+            {
+                if(it->second[i]->loop_ == loop && !it->second[i]->listener_)
+                {
+                    shard = it->second[i];
+                    break;
+                }
+            }
+        }
+
+        if(shard)
+        {
+            sockaddr_storage sockAddr;
+            int sockLen = base::makeAddr(ci.getCurrAddrInfo(), sockAddr);
+
+            shard->listener_ = createReusePortServer(loop->get_event(), onShardAccept<T>, shard, (const sockaddr *)&sockAddr, sockLen);
+        }
+    }
+
+    void addMetricsInLoop(ConnInfo & ci);
     void delServerInLoop(ConnInfo & ci);
+    static void delShardInLoop(Shard * shard);
 
     static evconnlistener * createServer(struct event_base *base, evconnlistener_cb cb, void *ptr, const struct sockaddr *sa, int socklen);
+    static evconnlistener * createReusePortServer(struct event_base *base, evconnlistener_cb cb, void *ptr, const struct sockaddr *sa, int socklen);
 
     template<typename T>
-    void onAccept(ConnInfo & ci)
+    void onAccept(struct evconnlistener * listener, ConnInfo & ci)
     {
         base::setTcpNoDely(ci.fd(), true);
         base::setKeepAlive(ci.fd(), true);
@@ -66,11 +175,42 @@ private:
         BaseConnPtr  pConn(new T);
         pConn->setConnectCallback(std::bind(&TcpServer::onConnect, this, pConn));
         pConn->setCloseCallback(std::bind(&TcpServer::onClose, this, pConn));
+
+        auto it = listenLimits_.find(listener);
+        setConnRateLimit(pConn, it != listenLimits_.end() ? &it->second : nullptr);
+        pConn->doAccept(ci);
+    }
+
+    template<typename T>
+    static void onAccept(struct evconnlistener * listener,
+                        int sockfd,
+                        struct sockaddr * sockAddr,
+                        int sockLen,
+                        void * arg)
+    {
+        ConnInfo ci(sockfd);
+        ci.addAddrInfo(base::getAddr(sockAddr, sockLen));
+        static_cast<TcpServer *>(arg)->onAccept<T>(listener, ci);
+    }
+
+    template<typename T>
+    void onAccept(EventLoop * loop, const ListenLimit * limit, ConnInfo & ci)
+    {
+        base::setTcpNoDely(ci.fd(), true);
+        base::setKeepAlive(ci.fd(), true);
+
+        BaseConnPtr  pConn(new T(loop));
+        pConn->setConnectCallback(std::bind(&TcpServer::onConnect, this, pConn));
+        pConn->setCloseCallback(std::bind(&TcpServer::onClose, this, pConn));
+        setConnRateLimit(pConn, limit);
         pConn->doAccept(ci);
     }
 
+    //the limits of the listener, else those of the server
+    void setConnRateLimit(const BaseConnPtr & pConn, const ListenLimit * limit);
+
     template<typename T>
-    static void onAccept(struct evconnlistener *,
+    static void onShardAccept(struct evconnlistener *,
                         int sockfd,
                         struct sockaddr * sockAddr,
                         int sockLen,
@@ -78,20 +218,33 @@ private:
     {
         ConnInfo ci(sockfd);
         ci.addAddrInfo(base::getAddr(sockAddr, sockLen));
-        static_cast<TcpServer *>(arg)->onAccept<T>(ci);
+        Shard * shard = static_cast<Shard *>(arg);
+        shard->server_->onAccept<T>(shard->loop_, &shard->limit_, ci);
     }
 
+    static void onMetricsAccept(struct evconnlistener *,
+                        int sockfd,
+                        struct sockaddr * sockAddr,
+                        int sockLen,
+                        void * arg);
+
     void onConnect(const BaseConnPtr & pConn);
     void onClose(const BaseConnPtr & pConn);
     void onMessage(const BaseConnPtr & pConn);
 private:
     EventLoop *             loop_;
+    EventLoopThreadPool *   pool_;
     struct evconnlistener * listener_;
 
     std::mutex               mutex_;
     std::set<ConnInfo>      connList_;
 
     ListenMap_t              listeners_;
+    ListenLimitMap_t         listenLimits_; // in the server loop, as listeners_
+    ShardMap_t               shards_;
+
+    RateLimitPtr             rateLimit_;
+    RateLimitGroupPtr        rateLimitGroup_;
 };
 
 #endif
@@ -2,69 +2,133 @@
 #define _THREAD_POOL_H_
 
 #include <vector>
-#include <queue>
+#include <deque>
+#include <atomic>
 #include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 
+#include "Task.h"
+#include "Future.h"
+
+/*
+   ThreadPool: work stealing pool
+
+   every worker owns a task deque, a task scheduled from a worker goes to its
+   own deque, others are spread round robin. an idle worker steals from the
+   other deques before it sleeps.
+ */
 class ThreadPool
 {
 public:
     ThreadPool(size_t threads = 1);
     ~ThreadPool();
 
-    void schedule(std::function<void()> && task)
+    void schedule(Task && task)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
-        _tasks.emplace(std::move(task));
-        _condition.notify_one();
+        size_t index = 0;
+        if(currentPool() == this)
+        {
+            index = currentWorker();
+        }
+        else
+        {
+            index = _next.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+        }
+
+        //count it under the queue lock, a worker that sees the count finds the task
+        {
+            std::unique_lock<std::mutex> lock(_queues[index]->_mutex);
+            _queues[index]->_tasks.emplace_back(std::move(task));
+            _pending.fetch_add(1);
+        }
+
+        if(_idle.load() > 0)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.notify_one();
+        }
+    }
+
+    //run f in the pool, the continuations of the future run on the caller loop
+    template<typename F>
+    auto submit(F && f) -> Future<typename FutureImpl::Result<decltype(f())>::type>
+    {
+        typedef typename std::decay<F>::type Fn;
+        typedef decltype(f()) R;
+
+        FutureImpl::SubmitRunner<Fn, R> runner = { std::forward<F>(f), Promise<typename FutureImpl::Result<R>::type>() };
+        auto future = runner.promise_.getFuture();
+        schedule(std::move(runner));
+        return future;
+    }
+
+    //the tasks not started yet
+    size_t pending() const
+    {
+        return _pending.load(std::memory_order_relaxed);
+    }
+
+    //the tasks running now
+    size_t active() const
+    {
+        return _active.load(std::memory_order_relaxed);
+    }
+private:
+    struct WorkQueue
+    {
+        std::mutex _mutex;
+        std::deque<Task> _tasks;
+    };
+
+    void workerFunc(size_t index);
+    bool popTask(size_t index, Task & task);
+    bool stealTask(size_t index, Task & task);
+    void takeTask(WorkQueue & queue, bool front, Task & task);
+
+    static ThreadPool *& currentPool()
+    {
+        static __thread ThreadPool * t_pool = nullptr;
+        return t_pool;
     }
 
-    size_t pending()
+    static size_t & currentWorker()
     {
-        return _tasks.size();
+        static __thread size_t t_worker = 0;
+        return t_worker;
     }
 private:
     // need to keep track of threads so we can join them
     std::vector< std::thread > _workers;
-    // the task queue
-    std::queue< std::function<void()> > _tasks;
+    // the task queue of every worker
+    std::vector< std::unique_ptr<WorkQueue> > _queues;
+
+    std::atomic<size_t> _next;
+    std::atomic<size_t> _pending;
+    std::atomic<size_t> _active;
+    std::atomic<size_t> _idle;
 
-    // synchronization
+    // synchronization, only for sleeping and waking the idle workers
     std::mutex _mutex;
     std::condition_variable _condition;
     bool _stop;
 };
 
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads):_stop(false)
+inline ThreadPool::ThreadPool(size_t threads):_next(0), _pending(0), _active(0), _idle(0), _stop(false)
 {
+    if(threads == 0)
+    {
+        threads = 1;
+    }
+
     for(size_t i = 0; i < threads; ++i)
-        _workers.emplace_back(
-            [this]
-            {
-                for(;;)
-                {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(_mutex);
-                        _condition.wait(lock, [this]{return _stop || !_tasks.empty();});
-                        if(_stop &&_tasks.empty())
-                        {
-                            return;
-                        }
-
-                        task = std::move(_tasks.front());
-                        _tasks.pop();
-                    }
-
-                    task();
-                }
-            }
-        );
+        _queues.emplace_back(new WorkQueue);
+
+    for(size_t i = 0; i < threads; ++i)
+        _workers.emplace_back(std::bind(&ThreadPool::workerFunc, this, i));
 }
 
 // the destructor joins all threads
@@ -80,4 +144,105 @@ inline ThreadPool::~ThreadPool()
         worker.join();
 }
 
+inline void ThreadPool::workerFunc(size_t index)
+{
+    currentPool() = this;
+    currentWorker() = index;
+
+    for(;;)
+    {
+        Task task;
+        if(popTask(index, task) || stealTask(index, task))
+        {
+            task();
+            _active.fetch_sub(1);
+            continue;
+        }
+
+        //every queue was empty when scanned, a task counted now was queued after
+        std::unique_lock<std::mutex> lock(_mutex);
+        //a producer counts _pending before it reads _idle, so one of us sees the other
+        _idle.fetch_add(1);
+        _condition.wait(lock, [this]{return _stop || _pending.load() > 0;});
+        _idle.fetch_sub(1);
+
+        if(_stop && _pending.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+inline bool ThreadPool::popTask(size_t index, Task & task)
+{
+    WorkQueue & queue = *_queues[index];
+    std::unique_lock<std::mutex> lock(queue._mutex);
+    if(queue._tasks.empty())
+    {
+        return false;
+    }
+
+    takeTask(queue, true, task);
+    return true;
+}
+
+//the free queues first, then wait for the busy ones, so a worker only
+//sleeps after a full scan, a failed try_lock would wake it right away
+inline bool ThreadPool::stealTask(size_t index, Task & task)
+{
+    bool busy = false;
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(size_t i = 1; i < _queues.size(); ++i)
+        {
+            WorkQueue & queue = *_queues[(index + i) % _queues.size()];
+            std::unique_lock<std::mutex> lock(queue._mutex, std::defer_lock);
+            if(pass == 0 && !lock.try_lock())
+            {
+                busy = true;
+                continue;
+            }
+
+            if(pass == 1)
+            {
+                lock.lock();
+            }
+
+            if(queue._tasks.empty())
+            {
+                continue;
+            }
+
+            //steal the newest one, the owner takes from the front
+            takeTask(queue, false, task);
+            return true;
+        }
+
+        if(!busy)
+        {
+            break;
+        }
+    }
+
+    return false;
+}
+
+//under the queue lock: count it active before it leaves pending, pending()+active() never drops early
+inline void ThreadPool::takeTask(WorkQueue & queue, bool front, Task & task)
+{
+    if(front)
+    {
+        task = std::move(queue._tasks.front());
+        queue._tasks.pop_front();
+    }
+    else
+    {
+        task = std::move(queue._tasks.back());
+        queue._tasks.pop_back();
+    }
+
+    _active.fetch_add(1);
+    _pending.fetch_sub(1);
+}
+
 #endif
@@ -1,33 +1,24 @@
 #include "TimeStamp.h"
-#include "StringOps.h"
-
-#include <sys/time.h>
+#include "Clock.h"
 
 std::string TimeStamp::format() const
 {
-    std::string strTime;
-
-    time_t seconds = this->seconds() + 8*3600;
-    int microseconds = this->microseconds()%(1000*1000);
-    struct tm tmtime_;
-    gmtime_r(&seconds, &tmtime_);
-    base::sprintfex(strTime, "%4d%02d%02d %02d:%02d:%02d.%06d",
-                        tmtime_.tm_year + 1900, tmtime_.tm_mon + 1, tmtime_.tm_mday,
-                        tmtime_.tm_hour, tmtime_.tm_min, tmtime_.tm_sec, microseconds);
-    return strTime;
+    char buf[32];
+    size_t len = Clock::formatTime(ms_, buf, sizeof(buf));
+    return std::string(buf, len);
 }
 
 TimeStamp TimeStamp::now()
 {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return TimeStamp(tv.tv_sec*MicroSecondsPerSecond + tv.tv_usec);
+    return TimeStamp(Clock::now());
 }
 
-time_t TimeStamp::time()
+TimeStamp TimeStamp::coarse()
 {
-    return ::time(nullptr);
+    return TimeStamp(Clock::coarse());
 }
 
-
-
+time_t TimeStamp::time()
+{
+    return static_cast<time_t>(Clock::coarse()/MicroSecondsPerSecond);
+}
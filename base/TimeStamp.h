@@ -30,6 +30,8 @@ public:
     std::string format() const;
 
     static TimeStamp now();
+    //a few ms behind now(), cheaper
+    static TimeStamp coarse();
     static time_t time();
 
 private:
@@ -6,7 +6,7 @@
 #include "BaseUtil.h"
 #include "EventLoop.h"
 
-TimerObj::TimerObj(EventLoop * loop, TimerId timerId, const struct timeval & tv, const Functor && cb, int type):
+TimerObj::TimerObj(EventLoop * loop, TimerId timerId, const struct timeval & tv, Functor && cb, int type):
     loop_(loop),
     timer_(nullptr),
     cb_(std::move(cb)),
@@ -35,11 +35,16 @@ TimerObj::~TimerObj()
     event_free(timer_);
 }
 
-TimerId TimerObj::createTimer(EventLoop * loop, const struct timeval & tv, const Functor && cb, int type)
+TimerId TimerObj::nextTimerId()
 {
     static std::atomic<TimerId> g_timerId(0);
-    TimerId timerId = ++g_timerId;
-    loop->runInLoop(std::bind(&TimerObj::startTimer, loop, timerId, tv, cb, type));
+    return ++g_timerId;
+}
+
+TimerId TimerObj::createTimer(EventLoop * loop, const struct timeval & tv, Functor && cb, int type)
+{
+    TimerId timerId = nextTimerId();
+    loop->runInLoop(std::bind(&TimerObj::startTimer, loop, timerId, tv, std::move(cb), type));
     return timerId;
 }
 
@@ -48,7 +53,7 @@ void TimerObj::deleteTimer(EventLoop * loop, TimerId timerId)
     loop->runInLoop(std::bind(&TimerObj::stopTimer, loop, timerId));
 }
 
-void TimerObj::startTimer(EventLoop * loop, TimerId timerId, const struct timeval & tv, const Functor & cb, int type)
+void TimerObj::startTimer(EventLoop * loop, TimerId timerId, const struct timeval & tv, Functor & cb, int type)
 {
     std::unique_ptr<TimerObj> timerObj(new TimerObj(loop, timerId, tv, std::move(cb), type));
     loop->addTimer(timerId, timerObj);
@@ -59,12 +64,29 @@ void TimerObj::stopTimer(EventLoop * loop, TimerId TimerId)
     loop->delTimer(TimerId);
 }
 
+//cb_ may cancel the timer and free this, so it runs moved out and nothing of
+//this is touched after it; a persistent timer still in the loop gets it back
 void TimerObj::onTimer()
 {
-    cb_();
-    if(type_ == TIMER_ONCE)
+    EventLoop * loop = loop_;
+    TimerId timerId = timerId_;
+    bool once = (type_ == TIMER_ONCE);
+
+    loop->enterCallback(TimeStamp::now().microseconds(), cb_.name(), "timer");
+    Functor cb(std::move(cb_));
+    cb();
+    loop->leaveCallback(TimeStamp::now().microseconds());
+    statAdd(loop->stats_.timersFired_, 1);
+    if(once)
+    {
+        stopTimer(loop, timerId);
+        return;
+    }
+
+    auto it = loop->timerMap_.find(timerId);
+    if(it != loop->timerMap_.end())
     {
-        stopTimer(loop_, timerId_);
+        it->second->cb_ = std::move(cb);
     }
 }
 
@@ -3,6 +3,8 @@
 
 #include <functional>
 
+#include "Task.h"
+
 class EventLoop;
 
 enum
@@ -11,22 +13,30 @@ enum
     TIMER_PERSIST
 };
 
+enum
+{
+    TIMER_BACKEND_EVENT = 0, // one libevent timer per TimerObj
+    TIMER_BACKEND_WHEEL // the hashed timing wheel, see TimerWheel
+};
+
 typedef int64_t TimerId;
 
 class TimerObj
 {
 private:
-    typedef std::function<void()> Functor;
-    TimerObj(EventLoop * loop, TimerId timerId, const struct timeval & tv, const Functor && cb, int type);
+    typedef Task Functor;
+    TimerObj(EventLoop * loop, TimerId timerId, const struct timeval & tv, Functor && cb, int type);
 public:
     ~TimerObj();
 
+    static TimerId nextTimerId();
+
 private:
-    static TimerId createTimer(EventLoop * loop, const struct timeval & tv, const Functor && cb, int type);
+    static TimerId createTimer(EventLoop * loop, const struct timeval & tv, Functor && cb, int type);
     static void deleteTimer(EventLoop * loop, TimerId timer);
 
     void onTimer();
-    static void startTimer(EventLoop * loop, TimerId timerId, const struct timeval & tv, const Functor & cb, int type);
+    static void startTimer(EventLoop * loop, TimerId timerId, const struct timeval & tv, Functor & cb, int type);
     static void stopTimer(EventLoop * loop, TimerId timerId);
     static void handleTimer(int fd, short which, void *arg);
 
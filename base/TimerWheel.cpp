@@ -0,0 +1,276 @@
+#include "TimerWheel.h"
+
+#include <time.h>
+#include <event2/event.h>
+
+#include "BaseUtil.h"
+#include "EventLoop.h"
+#include "Clock.h"
+
+static int64_t monotonicMs()
+{
+    return Clock::monotonic()/1000;
+}
+
+TimerWheel::TimerWheel(EventLoop * loop, int tickMs):
+    loop_(loop),
+    tickMs_(tickMs > 0 ? tickMs : TIMER_WHEEL_TICK_MS),
+    startMs_(monotonicMs()),
+    currTick_(0),
+    tick_(nullptr),
+    ticking_(false),
+    running_(nullptr)
+{
+    tick_ = event_new(loop_->get_event(), -1, EV_PERSIST, handleTick, this);
+    ASSERT_ABORT(tick_);
+}
+
+TimerWheel::~TimerWheel()
+{
+    event_del(tick_);
+    event_free(tick_);
+
+    for(auto it = timerMap_.begin(); it != timerMap_.end(); ++it)
+    {
+        if(it->second != running_)
+        {
+            delete it->second;
+        }
+    }
+}
+
+TimerId TimerWheel::createTimer(const struct timeval & tv, Functor && cb, int type)
+{
+    TimerId timerId = TimerObj::nextTimerId();
+    if(loop_->isInLoopThread())
+    {
+        addTimerInLoop(timerId, tv, cb, type);
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&TimerWheel::addTimerInLoop, this, timerId, tv, std::move(cb), type));
+    }
+
+    return timerId;
+}
+
+void TimerWheel::deleteTimer(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerWheel::delTimerInLoop, this, timerId));
+}
+
+void TimerWheel::addTimerInLoop(TimerId timerId, const struct timeval & tv, Functor & cb, int type)
+{
+    loop_->assertInLoopThread();
+
+    uint64_t now = nowTick();
+    if(!ticking_)
+    {
+        //catch the wheel up, it doesn't turn while there is no timer
+        currTick_ = now;
+
+        struct timeval tick = {tickMs_/1000, (tickMs_%1000)*1000};
+        event_add(tick_, &tick);
+        ticking_ = true;
+    }
+
+    Node * node = new Node;
+    node->timerId_ = timerId;
+    node->interval_ = toTicks(tv);
+    node->expire_ = now + node->interval_;
+    node->type_ = type;
+    node->cb_ = std::move(cb);
+
+    timerMap_.insert(std::make_pair(timerId, node));
+    addNode(node);
+}
+
+void TimerWheel::delTimerInLoop(TimerId timerId)
+{
+    auto it = timerMap_.find(timerId);
+    if(it == timerMap_.end())
+    {
+        return;
+    }
+
+    Node * node = it->second;
+    timerMap_.erase(it);
+
+    if(node == running_)
+    {
+        //free it after the callback return
+        node->canceled_ = true;
+    }
+    else
+    {
+        unlink(node);
+        delete node;
+    }
+}
+
+void TimerWheel::addNode(Node * node)
+{
+    unlink(node);
+
+    uint64_t expire = node->expire_;
+    int64_t  idx = static_cast<int64_t>(expire - currTick_);
+    Node * list = nullptr;
+
+    if(idx < 0)
+    {
+        //already expired, run it in the next tick
+        list = &root_[currTick_ & ROOT_MASK];
+    }
+    else if(idx < ROOT_SIZE)
+    {
+        list = &root_[expire & ROOT_MASK];
+    }
+    else
+    {
+        int level = 0;
+        for(; level < NUM_LEVELS - 1; ++level)
+        {
+            if(idx < (static_cast<int64_t>(1) << (ROOT_BITS + (level+1)*LEVEL_BITS)))
+            {
+                break;
+            }
+        }
+
+        if(idx >= (static_cast<int64_t>(1) << (ROOT_BITS + NUM_LEVELS*LEVEL_BITS)))
+        {
+            //out of range, park it in the farthest slot and cascade later
+            expire = currTick_ + (static_cast<uint64_t>(1) << (ROOT_BITS + NUM_LEVELS*LEVEL_BITS)) - 1;
+        }
+
+        list = &levels_[level][(expire >> (ROOT_BITS + level*LEVEL_BITS)) & LEVEL_MASK];
+    }
+
+    link(list, node);
+}
+
+void TimerWheel::cascade(int level, int index)
+{
+    Node list;
+    Node * head = &levels_[level][index];
+    if(head->next_ == head)
+    {
+        return;
+    }
+
+    //move the whole slot out, then rehash every node into the lower wheels
+    list.next_ = head->next_;
+    list.prev_ = head->prev_;
+    list.next_->prev_ = &list;
+    list.prev_->next_ = &list;
+    head->next_ = head->prev_ = head;
+
+    while(list.next_ != &list)
+    {
+        addNode(list.next_);
+    }
+}
+
+void TimerWheel::runTick()
+{
+    int index = static_cast<int>(currTick_ & ROOT_MASK);
+    if(index == 0)
+    {
+        for(int level = 0; level < NUM_LEVELS; ++level)
+        {
+            int idx = static_cast<int>((currTick_ >> (ROOT_BITS + level*LEVEL_BITS)) & LEVEL_MASK);
+            cascade(level, idx);
+            if(idx != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    Node list;
+    Node * head = &root_[index];
+    if(head->next_ != head)
+    {
+        list.next_ = head->next_;
+        list.prev_ = head->prev_;
+        list.next_->prev_ = &list;
+        list.prev_->next_ = &list;
+        head->next_ = head->prev_ = head;
+    }
+
+    ++currTick_;
+
+    while(list.next_ != &list)
+    {
+        Node * node = list.next_;
+        unlink(node);
+
+        running_ = node;
+        loop_->enterCallback(TimeStamp::now().microseconds(), node->cb_.name(), "timer");
+        node->cb_();
+        loop_->leaveCallback(TimeStamp::now().microseconds());
+        statAdd(loop_->stats_.timersFired_, 1);
+        running_ = nullptr;
+
+        if(node->canceled_)
+        {
+            delete node;
+        }
+        else if(node->type_ == TIMER_PERSIST)
+        {
+            node->expire_ = currTick_ - 1 + node->interval_;
+            addNode(node);
+        }
+        else
+        {
+            timerMap_.erase(node->timerId_);
+            delete node;
+        }
+    }
+}
+
+void TimerWheel::onTick()
+{
+    uint64_t now = nowTick();
+    while(currTick_ <= now)
+    {
+        runTick();
+    }
+
+    if(timerMap_.empty() && ticking_)
+    {
+        event_del(tick_);
+        ticking_ = false;
+    }
+}
+
+uint64_t TimerWheel::nowTick() const
+{
+    return static_cast<uint64_t>(monotonicMs() - startMs_)/tickMs_;
+}
+
+uint64_t TimerWheel::toTicks(const struct timeval & tv) const
+{
+    int64_t ms = static_cast<int64_t>(tv.tv_sec)*1000 + tv.tv_usec/1000;
+    int64_t ticks = (ms + tickMs_ - 1)/tickMs_;
+    return ticks > 0 ? static_cast<uint64_t>(ticks) : 1;
+}
+
+void TimerWheel::link(Node * list, Node * node)
+{
+    node->prev_ = list->prev_;
+    node->next_ = list;
+    list->prev_->next_ = node;
+    list->prev_ = node;
+}
+
+void TimerWheel::unlink(Node * node)
+{
+    node->prev_->next_ = node->next_;
+    node->next_->prev_ = node->prev_;
+    node->prev_ = node->next_ = node;
+}
+
+void TimerWheel::handleTick(int, short, void * arg)
+{
+    static_cast<TimerWheel *>(arg)->onTick();
+}
@@ -0,0 +1,89 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <unordered_map>
+
+#include "TimerId.h"
+#include "Task.h"
+
+class EventLoop;
+
+#define TIMER_WHEEL_TICK_MS 10
+
+/*
+   TimerWheel: hierarchical timing wheel, one root wheel of 256 slots and
+   four cascading wheels of 64 slots, driven by a single libevent tick.
+
+   add and cancel are O(1); timers are rounded up to the tick resolution.
+   All the members except createTimer/deleteTimer run in the loop thread.
+ */
+class TimerWheel
+{
+public:
+    typedef Task Functor;
+
+    TimerWheel(EventLoop * loop, int tickMs = TIMER_WHEEL_TICK_MS);
+    ~TimerWheel();
+
+    TimerId createTimer(const struct timeval & tv, Functor && cb, int type);
+    void deleteTimer(TimerId timerId);
+
+    size_t size() const { return timerMap_.size(); }
+private:
+    enum
+    {
+        ROOT_BITS = 8,
+        LEVEL_BITS = 6,
+        ROOT_SIZE = 1 << ROOT_BITS,
+        LEVEL_SIZE = 1 << LEVEL_BITS,
+        ROOT_MASK = ROOT_SIZE - 1,
+        LEVEL_MASK = LEVEL_SIZE - 1,
+        NUM_LEVELS = 4
+    };
+
+    struct Node
+    {
+        Node():prev_(this), next_(this), timerId_(0), expire_(0), interval_(0), type_(TIMER_ONCE), canceled_(false) {}
+
+        Node *      prev_;
+        Node *      next_;
+        TimerId     timerId_;
+        uint64_t    expire_; // the expire tick
+        uint64_t    interval_; // the interval in ticks
+        int         type_;
+        bool        canceled_;
+        Functor     cb_;
+    };
+
+    void addTimerInLoop(TimerId timerId, const struct timeval & tv, Functor & cb, int type);
+    void delTimerInLoop(TimerId timerId);
+
+    void addNode(Node * node);
+    void cascade(int level, int index);
+    void runTick();
+    void onTick();
+
+    uint64_t nowTick() const;
+    uint64_t toTicks(const struct timeval & tv) const;
+
+    static void link(Node * list, Node * node);
+    static void unlink(Node * node);
+    static void handleTick(int fd, short which, void * arg);
+
+private:
+    EventLoop *     loop_;
+    int             tickMs_;
+    int64_t         startMs_; // the monotonic start time
+    uint64_t        currTick_; // the next tick to run
+    struct event *  tick_;
+    bool            ticking_;
+    Node *          running_; // the timer whose callback is running
+
+    Node            root_[ROOT_SIZE];
+    Node            levels_[NUM_LEVELS][LEVEL_SIZE];
+
+    std::unordered_map<TimerId, Node *> timerMap_;
+};
+
+#endif
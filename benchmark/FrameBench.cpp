@@ -0,0 +1,172 @@
+/*
+   FrameBench: frames per second out of an evbuffer, the way
+   BaseConn::readFrames takes them (copy out the prefix, decode it, peek the
+   frame in place, drain it) against the manual path it replaced (copy out
+   the prefix, drain it, evbuffer_remove the body into a fresh std::vector)
+
+   the input is encoded and added to one evbuffer per path before the timer,
+   in pieces of 16KB like the socket reads of a bufferevent, so the frames
+   straddle the chains as they do on a connection; only the decode is timed
+
+    ./FrameBench [frames]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <event2/buffer.h>
+#include "FrameCodec.h"
+
+namespace
+{
+
+const size_t ReadSize = 16384; // the most a bufferevent reads at once
+const size_t MaxBytes = 64*1024*1024; // the input of one run
+
+struct Case
+{
+    const char * name_;
+    int type_;
+    size_t lengthBytes_;
+};
+
+struct evbuffer * makeInput(const std::vector<char> & stream)
+{
+    struct evbuffer * input = evbuffer_new();
+    for(size_t pos = 0; pos < stream.size(); pos += ReadSize)
+    {
+        size_t n = stream.size() - pos < ReadSize ? stream.size() - pos : ReadSize;
+        evbuffer_add(input, &stream[pos], n);
+    }
+
+    return input;
+}
+
+//the prefix of the next frame, false at the end of the input
+bool nextFrame(const FrameCodec & codec, struct evbuffer * input, size_t & headerLen, size_t & frameLen)
+{
+    size_t inputLen = evbuffer_get_length(input);
+    if(inputLen == 0)
+    {
+        return false;
+    }
+
+    char header[FrameCodec::MaxHeaderSize];
+    ev_ssize_t n = evbuffer_copyout(input, header, inputLen < sizeof(header) ? inputLen : sizeof(header));
+    if(codec.decode(header, static_cast<size_t>(n), headerLen, frameLen) != FrameCodec::DECODE_FRAME || inputLen < frameLen)
+    {
+        fprintf(stderr, "decode failed with %zu bytes left\n", inputLen);
+        exit(1);
+    }
+
+    return true;
+}
+
+//BaseConn::readFrames and BaseConn::peek
+size_t readFrames(const FrameCodec & codec, struct evbuffer * input, size_t & sum)
+{
+    size_t frames = 0;
+    size_t headerLen = 0;
+    size_t frameLen = 0;
+    while(nextFrame(codec, input, headerLen, frameLen))
+    {
+        const char * data = nullptr;
+        struct evbuffer_iovec vec;
+        if(evbuffer_peek(input, frameLen, nullptr, &vec, 1) >= 1 && vec.iov_len >= frameLen)
+        {
+            data = static_cast<const char *>(vec.iov_base);
+        }
+        else
+        {
+            data = reinterpret_cast<const char *>(evbuffer_pullup(input, frameLen));
+        }
+
+        FrameView frame(data, frameLen, headerLen);
+        sum += static_cast<unsigned char>(frame.body()[0]) + frame.bodySize();
+        evbuffer_drain(input, frameLen);
+        ++frames;
+    }
+
+    return frames;
+}
+
+//the manual path: the body is copied out into its own vector
+size_t readManual(const FrameCodec & codec, struct evbuffer * input, size_t & sum)
+{
+    size_t frames = 0;
+    size_t headerLen = 0;
+    size_t frameLen = 0;
+    while(nextFrame(codec, input, headerLen, frameLen))
+    {
+        evbuffer_drain(input, headerLen);
+        std::vector<char> body(frameLen - headerLen);
+        evbuffer_remove(input, body.data(), body.size());
+
+        sum += static_cast<unsigned char>(body[0]) + body.size();
+        ++frames;
+    }
+
+    return frames;
+}
+
+typedef size_t (*ReadFn)(const FrameCodec &, struct evbuffer *, size_t &);
+
+double bench(const FrameCodec & codec, const std::vector<char> & stream, size_t frames, size_t bodyLen, ReadFn read)
+{
+    struct evbuffer * input = makeInput(stream);
+
+    size_t sum = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t decoded = read(codec, input, sum);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    evbuffer_free(input);
+
+    if(decoded != frames || sum != frames*('x' + bodyLen))
+    {
+        fprintf(stderr, "decoded %zu of %zu frames\n", decoded, frames);
+        exit(1);
+    }
+
+    return frames/std::chrono::duration<double>(end - begin).count();
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    size_t maxFrames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    const Case cases[] = {
+        { "fixed4", FrameCodec::LENGTH_FIXED, 4 },
+        { "fixed8", FrameCodec::LENGTH_FIXED, 8 },
+        { "varint", FrameCodec::LENGTH_VARINT, 0 },
+    };
+    const size_t bodies[] = { 16, 256, 4096 };
+
+    printf("%-8s %8s %16s %16s %8s\n", "codec", "body", "readFrames/s", "manual/s", "ratio");
+    for(size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i)
+    {
+        FrameCodec codec(cases[i].type_, cases[i].lengthBytes_);
+        for(size_t j = 0; j < sizeof(bodies)/sizeof(bodies[0]); ++j)
+        {
+            size_t frames = MaxBytes/(bodies[j] + FrameCodec::MaxHeaderSize);
+            frames = frames < maxFrames ? frames : maxFrames;
+
+            std::vector<char> body(bodies[j], 'x');
+            std::vector<char> stream;
+            char header[FrameCodec::MaxHeaderSize];
+            for(size_t k = 0; k < frames; ++k)
+            {
+                size_t headerLen = codec.encode(header, bodies[j]);
+                stream.insert(stream.end(), header, header + headerLen);
+                stream.insert(stream.end(), body.begin(), body.end());
+            }
+
+            double frameRate = bench(codec, stream, frames, bodies[j], readFrames);
+            double manualRate = bench(codec, stream, frames, bodies[j], readManual);
+            printf("%-8s %8zu %16.0f %16.0f %8.2f\n", cases[i].name_, bodies[j], frameRate, manualRate, frameRate/manualRate);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+   LogBench: the lines per second of AsyncLogging at 1, 4 and 16 threads,
+   the locked logger list (RingSize=0) against the thread rings, formatted
+   in the logging thread and Deferred to the log thread
+
+   the time runs until the logger is destroyed, so every line is on disk;
+   the files go to a temp folder beside the binary, removed at the end
+
+    ./LogBench [lines per configuration]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include "AsyncLogging.h"
+#include "FileOps.h"
+
+namespace
+{
+
+struct Config
+{
+    const char * name_;
+    const char * conf_;
+};
+
+const Config configs[] =
+{
+    { "locked", "RingSize=0\n" },
+    { "ring", "RingSize=1024\n" },
+    { "deferred", "RingSize=1024\nDeferred=1\n" },
+};
+
+//the Folder of the log is relative to the binary
+std::string writeConfig(const std::string & path, const std::string & folder, const Config & config)
+{
+    std::string fileName = path + "/" + config.name_ + ".conf";
+    FILE * fp = fopen(fileName.c_str(), "w");
+    if(!fp)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    fprintf(fp, "Folder=%s\nName=%s\nPrint=0\n%s", folder.c_str(), config.name_, config.conf_);
+    fclose(fp);
+    return fileName;
+}
+
+//the threads are new for each run, a thread keeps the ring of the first AsyncLogging it logs to
+double bench(const std::string & conf, int threads, size_t count)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    {
+        AsyncLogging logger(conf.c_str());
+
+        std::vector<std::thread> workers;
+        for(int i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([&logger, i, count]() {
+                for(size_t j = 0; j < count; ++j)
+                {
+                    logger.log(Logger::INFO, __FILE__, __LINE__, __FUNCTION__, "thread=%d line=%d value=%s", i, static_cast<int>(j), "bench");
+                }
+            });
+        }
+
+        for(size_t i = 0; i < workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return threads*count/std::chrono::duration<double>(end - begin).count();
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 400000;
+    const int threads[] = { 1, 4, 16 };
+    const size_t nconfigs = sizeof(configs)/sizeof(configs[0]);
+
+    std::string path = base::getPwd() + "LogBenchXXXXXX";
+    if(!mkdtemp(&path[0]))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string folder = path.substr(path.rfind('/') + 1);
+
+    std::string confs[nconfigs];
+    for(size_t i = 0; i < nconfigs; ++i)
+    {
+        confs[i] = writeConfig(path, folder, configs[i]);
+    }
+
+    printf("%-10s", "threads");
+    for(size_t i = 0; i < nconfigs; ++i)
+    {
+        printf(" %14s/s", configs[i].name_);
+    }
+    printf("\n");
+
+    for(size_t i = 0; i < sizeof(threads)/sizeof(threads[0]); ++i)
+    {
+        printf("%-10d", threads[i]);
+        for(size_t j = 0; j < nconfigs; ++j)
+        {
+            printf(" %16.0f", bench(confs[j], threads[i], count/threads[i]));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    std::string rm = "rm -rf " + path;
+    return system(rm.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/*
+   LogFileBench: the MB/s of LogFile for lines of 64, 256 and 4096 bytes,
+   written synchronously and through io_uring when the kernel has it
+
+   the time runs until the LogFile is destroyed, so the data is written;
+   the files go to a temp folder beside the binary, removed at the end
+
+    ./LogFileBench [MB per run]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "LogFile.h"
+#include "FileOps.h"
+
+namespace
+{
+
+double bench(const std::string & folder, size_t lineSize, bool uring, size_t total)
+{
+    std::string line(lineSize - 1, 'x');
+    line += '\n';
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    {
+        LogFile logFile;
+        logFile.setLogFolder(folder);
+        logFile.setBaseName(uring ? "uring" : "sync");
+        if(uring && !logFile.setIoUring(true))
+        {
+            return 0;
+        }
+
+        for(size_t n = 0; n < total; n += lineSize)
+        {
+            logFile.append(line.data(), static_cast<int>(line.size()));
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return total/1048576.0/std::chrono::duration<double>(end - begin).count();
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 10) : 256) << 20;
+    const size_t lineSizes[] = { 64, 256, 4096 };
+
+    //the folder of LogFile is relative to the binary
+    std::string path = base::getPwd() + "LogFileBenchXXXXXX";
+    if(!mkdtemp(&path[0]))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string folder = path.substr(path.rfind('/') + 1);
+
+    printf("%-10s %12s %12s\n", "line", "sync MB/s", "uring MB/s");
+    for(size_t i = 0; i < sizeof(lineSizes)/sizeof(lineSizes[0]); ++i)
+    {
+        double sync = bench(folder, lineSizes[i], false, total);
+        double uring = bench(folder, lineSizes[i], true, total);
+        if(uring > 0)
+        {
+            printf("%-10d %12.0f %12.0f\n", static_cast<int>(lineSizes[i]), sync, uring);
+        }
+        else
+        {
+            printf("%-10d %12.0f %12s\n", static_cast<int>(lineSizes[i]), sync, "n/a");
+        }
+        fflush(stdout);
+    }
+
+    std::string rm = "rm -rf " + path;
+    return system(rm.c_str()) == 0 ? 0 : 1;
+}
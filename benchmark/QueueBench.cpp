@@ -0,0 +1,231 @@
+/*
+   QueueBench: the pending functor queue of EventLoop, the mutex and vector
+   swap it had before against MpscQueue, at 1, 4 and 16 producers
+
+   both run the protocol of EventLoop: the producer that makes the count
+   nonzero wakes the consumer, the consumer takes the counted functors in
+   one pass. the wakeup is a condition variable here instead of the eventfd
+
+   the same producer threads run a warm up round, then the timed one, as
+   the long lived threads of a server do; operator new is counted in the
+   timed round, the recycled nodes of MpscQueue should make it ~0 per push
+
+    ./QueueBench [functors per round]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <new>
+#include "MpscQueue.h"
+#include "Task.h"
+
+namespace
+{
+
+std::atomic<size_t> allocs(0);
+
+//the wakeup of the consumer, an eventfd in EventLoop
+class Wakeup
+{
+public:
+    Wakeup():signaled_(false) {}
+
+    void wakeup()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        signaled_ = true;
+        cond_.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return signaled_; });
+        signaled_ = false;
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool signaled_;
+};
+
+//the queue of EventLoop before the MpscQueue
+class LockedQueue
+{
+public:
+    LockedQueue():size_(0) {}
+
+    void queue(std::function<void()> && cb)
+    {
+        size_t size = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            size = size_++;
+            functors_.emplace_back(std::move(cb));
+        }
+
+        if(size == 0)
+        {
+            wakeup_.wakeup();
+        }
+    }
+
+    void run()
+    {
+        wakeup_.wait();
+
+        std::vector<std::function<void()> > functors;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            size_ = 0;
+            functors.swap(functors_);
+        }
+
+        for(size_t i = 0; i < functors.size(); ++i)
+        {
+            functors[i]();
+        }
+    }
+private:
+    std::mutex mutex_;
+    size_t size_;
+    std::vector<std::function<void()> > functors_;
+    Wakeup wakeup_;
+};
+
+//the queue of EventLoop now
+class LockFreeQueue
+{
+public:
+    LockFreeQueue():size_(0) {}
+
+    void queue(Task && cb)
+    {
+        functors_.push(std::move(cb));
+        if(size_.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            wakeup_.wakeup();
+        }
+    }
+
+    void run()
+    {
+        wakeup_.wait();
+
+        size_t size = size_.exchange(0, std::memory_order_acq_rel);
+        if(functors_.popCounted(size_, size, [](Task & cb) { cb(); }))
+        {
+            wakeup_.wakeup();
+        }
+    }
+private:
+    MpscQueue<Task> functors_;
+    std::atomic<size_t> size_;
+    Wakeup wakeup_;
+};
+
+struct Result
+{
+    double rate_; // functors per second
+    double allocs_; // per functor
+};
+
+template<typename Queue>
+Result bench(int producers, size_t count)
+{
+    Queue queue;
+    size_t total = producers*count;
+    size_t done = 0;
+    std::atomic<int> round(0);
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&queue, &done, &round, count]() {
+            for(int r = 1; r <= 2; ++r)
+            {
+                while(round.load(std::memory_order_acquire) < r)
+                {
+                    std::this_thread::yield();
+                }
+
+                for(size_t j = 0; j < count; ++j)
+                {
+                    queue.queue([&done]() { ++done; });
+                }
+            }
+        });
+    }
+
+    //the warm up round
+    round.store(1, std::memory_order_release);
+    while(done < total)
+    {
+        queue.run();
+    }
+
+    size_t before = allocs.load();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    round.store(2, std::memory_order_release);
+    while(done < 2*total)
+    {
+        queue.run();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    Result result;
+    result.rate_ = total/std::chrono::duration<double>(end - begin).count();
+    result.allocs_ = static_cast<double>(allocs.load() - before)/total;
+
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    return result;
+}
+
+}
+
+void * operator new(size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    void * p = malloc(size ? size : 1);
+    if(!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+int main(int argc, char * argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    const int producers[] = { 1, 4, 16 };
+
+    printf("%-10s %14s %14s %14s %14s\n", "producers", "mutex/s", "mutex allocs", "mpsc/s", "mpsc allocs");
+    for(size_t i = 0; i < sizeof(producers)/sizeof(producers[0]); ++i)
+    {
+        Result locked = bench<LockedQueue>(producers[i], count/producers[i]);
+        Result lockFree = bench<LockFreeQueue>(producers[i], count/producers[i]);
+        printf("%-10d %14.0f %14.4f %14.0f %14.4f\n", producers[i], locked.rate_, locked.allocs_, lockFree.rate_, lockFree.allocs_);
+    }
+
+    return 0;
+}
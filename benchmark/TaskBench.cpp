@@ -0,0 +1,197 @@
+/*
+   TaskBench: the heap allocations and the time per queued callback
+
+   first the callable alone, std::function against Task: each callback is
+   built, moved into a slot, moved out and run. then the real path, another
+   thread queues the Tasks with EventLoop::queueInLoop and the loop runs
+   them, that counts the MpscQueue node too. the loop path runs a warm up
+   round first, as the nodes are recycled after it; operator new is counted
+
+    ./TaskBench [tasks per callable]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <new>
+#include "Task.h"
+#include "EventLoop.h"
+
+namespace
+{
+
+std::atomic<size_t> allocs(0);
+
+struct Conn
+{
+    Conn():count_(0) {}
+    void onPdu(const std::shared_ptr<int> & pdu) { count_ += *pdu; }
+
+    int count_;
+};
+typedef std::shared_ptr<Conn> ConnPtr;
+
+//std::bind of a member with two shared_ptr, the sendPdu shape
+struct BindMaker
+{
+    const char * name() const { return "bind+2 shared_ptr"; }
+    std::function<void()> operator()(const ConnPtr & conn, const std::shared_ptr<int> & pdu) const
+    {
+        return std::bind(&Conn::onPdu, conn, pdu);
+    }
+};
+
+//a lambda with two shared_ptr and a string, 64 bytes, above the inline size of Task
+struct LambdaMaker
+{
+    const char * name() const { return "lambda 64 bytes"; }
+    std::function<void()> operator()(const ConnPtr & conn, const std::shared_ptr<int> & pdu) const
+    {
+        std::string tag("t");
+        return [conn, pdu, tag]() { conn->count_ += *pdu + static_cast<int>(tag.size()); };
+    }
+};
+
+//the same callables built straight into a Task
+template<typename Maker>
+struct TaskMaker;
+
+template<>
+struct TaskMaker<BindMaker>
+{
+    Task operator()(const ConnPtr & conn, const std::shared_ptr<int> & pdu) const
+    {
+        return Task(std::bind(&Conn::onPdu, conn, pdu));
+    }
+};
+
+template<>
+struct TaskMaker<LambdaMaker>
+{
+    Task operator()(const ConnPtr & conn, const std::shared_ptr<int> & pdu) const
+    {
+        std::string tag("t");
+        return Task([conn, pdu, tag]() { conn->count_ += *pdu + static_cast<int>(tag.size()); });
+    }
+};
+
+struct Result
+{
+    double allocs_; // per task
+    double ns_; // per task
+};
+
+template<typename Fn, typename Make>
+Result bench(const Make & make, size_t count)
+{
+    ConnPtr conn = std::make_shared<Conn>();
+    std::shared_ptr<int> pdu = std::make_shared<int>(1);
+    Fn slot;
+
+    size_t before = allocs.load();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; ++i)
+    {
+        slot = make(conn, pdu);
+        Fn cb(std::move(slot));
+        cb();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    Result result;
+    result.allocs_ = static_cast<double>(allocs.load() - before)/count;
+    result.ns_ = std::chrono::duration<double, std::nano>(end - begin).count()/count;
+    return result;
+}
+
+//queue count Tasks from this thread, wait until the loop ran them
+template<typename Maker>
+void queueRound(EventLoop * loop, const ConnPtr & conn, const std::shared_ptr<int> & pdu, size_t count)
+{
+    TaskMaker<Maker> make;
+    for(size_t i = 0; i < count; ++i)
+    {
+        loop->queueInLoop(make(conn, pdu));
+    }
+
+    std::promise<void> done;
+    std::future<void> ran = done.get_future();
+    loop->queueInLoop([&done]() { done.set_value(); });
+    ran.wait();
+}
+
+template<typename Maker>
+Result loopBench(size_t count)
+{
+    EventLoop loop;
+    ConnPtr conn = std::make_shared<Conn>();
+    std::shared_ptr<int> pdu = std::make_shared<int>(1);
+    Result result;
+
+    std::thread producer([&loop, &conn, &pdu, &result, count]() {
+        queueRound<Maker>(&loop, conn, pdu, count);
+
+        size_t before = allocs.load();
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        queueRound<Maker>(&loop, conn, pdu, count);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        //the promise and the future of the round are in the count, 1/count each
+        result.allocs_ = static_cast<double>(allocs.load() - before)/count;
+        result.ns_ = std::chrono::duration<double, std::nano>(end - begin).count()/count;
+        loop.queueInLoop([&loop]() { loop.quit(); });
+    });
+
+    loop.loop();
+    producer.join();
+    return result;
+}
+
+template<typename Maker>
+void run(size_t count)
+{
+    Maker maker;
+    Result function = bench<std::function<void()> >(maker, count);
+    Result task = bench<Task>(TaskMaker<Maker>(), count);
+    Result queued = loopBench<Maker>(count);
+    printf("%-20s %12.2f %12.1f %12.2f %12.1f %12.4f %12.1f\n", maker.name(),
+           function.allocs_, function.ns_, task.allocs_, task.ns_, queued.allocs_, queued.ns_);
+}
+
+}
+
+void * operator new(size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    void * p = malloc(size ? size : 1);
+    if(!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+int main(int argc, char * argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    printf("%-20s %12s %12s %12s %12s %12s %12s\n", "callable", "func allocs", "func ns", "task allocs", "task ns", "queue allocs", "queue ns");
+    run<BindMaker>(count);
+    run<LambdaMaker>(count);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+   ThreadPoolBench: tasks per second of ThreadPool against the single queue
+   pool it replaced, and the cpu the workers burn while idle
+
+   flat: one thread schedules all the tasks
+   fanout: each task scheduled from outside schedules more from its worker
+
+    ./ThreadPoolBench [tasks] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <queue>
+#include "ThreadPool.h"
+
+namespace
+{
+
+//the ThreadPool before the work stealing one
+class LockedPool
+{
+public:
+    LockedPool(size_t threads):stop_(false)
+    {
+        for(size_t i = 0; i < threads; ++i)
+        {
+            workers_.emplace_back([this]() {
+                for(;;)
+                {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                        if(stop_ && tasks_.empty())
+                        {
+                            return;
+                        }
+
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+
+                    task();
+                }
+            });
+        }
+    }
+
+    ~LockedPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+            condition_.notify_all();
+        }
+
+        for(size_t i = 0; i < workers_.size(); ++i)
+        {
+            workers_[i].join();
+        }
+    }
+
+    void schedule(std::function<void()> && task)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        tasks_.emplace(std::move(task));
+        condition_.notify_one();
+    }
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_;
+};
+
+const size_t FanOut = 16;
+
+template<typename Pool>
+double flat(Pool & pool, size_t tasks)
+{
+    std::atomic<size_t> done(0);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < tasks; ++i)
+    {
+        pool.schedule([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+
+    while(done.load() < tasks)
+    {
+        std::this_thread::yield();
+    }
+
+    return tasks/std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template<typename Pool>
+double fanout(Pool & pool, size_t tasks)
+{
+    std::atomic<size_t> done(0);
+    size_t parents = tasks/FanOut;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < parents; ++i)
+    {
+        pool.schedule([&pool, &done]() {
+            for(size_t j = 0; j < FanOut; ++j)
+            {
+                pool.schedule([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+
+    while(done.load() < parents*FanOut)
+    {
+        std::this_thread::yield();
+    }
+
+    return parents*FanOut/std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//the cpu ms of the process while it sleeps, that is of the idle workers
+double idleCpu(int ms)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    getrusage(RUSAGE_SELF, &after);
+
+    return (after.ru_utime.tv_sec - before.ru_utime.tv_sec + after.ru_stime.tv_sec - before.ru_stime.tv_sec)*1000.0
+        + (after.ru_utime.tv_usec - before.ru_utime.tv_usec + after.ru_stime.tv_usec - before.ru_stime.tv_usec)/1000.0;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    size_t tasks = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t threads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 4;
+
+    printf("%zu threads, %zu tasks\n", threads, tasks);
+    printf("%-10s %16s %16s %14s\n", "pool", "flat/s", "fanout/s", "idle cpu ms");
+    {
+        LockedPool pool(threads);
+        double f = flat(pool, tasks);
+        double o = fanout(pool, tasks);
+        printf("%-10s %16.0f %16.0f %14.1f\n", "locked", f, o, idleCpu(500));
+    }
+    {
+        ThreadPool pool(threads);
+        double f = flat(pool, tasks);
+        double o = fanout(pool, tasks);
+        printf("%-10s %16.0f %16.0f %14.1f\n", "stealing", f, o, idleCpu(500));
+    }
+
+    return 0;
+}
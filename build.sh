@@ -4,6 +4,7 @@ print_help(){
 	echo "Usage: "
     echo "  $0 clean --- clean all build"
     echo "  $0 version version_str Debug/Release--- build a version"
+    echo "  $0 test Debug/Release --- build and run the tests, after base and dbproxy"
 }
 
 check_env(){
@@ -48,6 +49,27 @@ build(){
 	cp -R $PROJECT/*.a /usr/local/lib
 }
 
+runtest(){
+    BUILDTYPE=Release
+    if  [ "$1"x = "Debug"x ]; then
+            BUILDTYPE=Debug
+    fi
+
+    mkdir -p test/$BUILDTYPE
+    cd test/$BUILDTYPE
+
+    cmake -DCMAKE_BUILD_TYPE=$BUILDTYPE -B. -H../
+
+    make && ctest --output-on-failure
+    if [ $? -eq 0 ]; then
+        echo "test successed";
+    else
+        echo "test failed";
+        exit 1;
+    fi
+
+    cd ../../
+}
 
 clean() {
 	echo "begin clean $1 $2"
@@ -81,6 +103,9 @@ case $1 in
 		build base $2
 		build dbproxy $2
 		;;
+	test)
+		runtest $2
+		;;
 	*)	
 		print_help
 		;;
@@ -0,0 +1,283 @@
+#include "AsyncRedisProxyConn.h"
+
+#include <stdarg.h>
+#include <event2/event.h>
+#include <hiredis-vip/hircluster.h>
+#include "base/BaseUtil.h"
+#include "base/EventLoop.h"
+
+namespace
+{
+
+//the read and write events of one node connection, on the event_base of the loop
+struct RedisEvents
+{
+    redisAsyncContext * context_;
+    struct event * read_;
+    struct event * write_;
+};
+
+void handleRead(evutil_socket_t fd, short events, void * arg)
+{
+    NOTUSED_ARG(fd);
+    NOTUSED_ARG(events);
+    redisAsyncHandleRead(static_cast<RedisEvents *>(arg)->context_);
+}
+
+void handleWrite(evutil_socket_t fd, short events, void * arg)
+{
+    NOTUSED_ARG(fd);
+    NOTUSED_ARG(events);
+    redisAsyncHandleWrite(static_cast<RedisEvents *>(arg)->context_);
+}
+
+//hiredis adds the events again when it wants more, they are not persistent
+void addRead(void * privdata)
+{
+    event_add(static_cast<RedisEvents *>(privdata)->read_, nullptr);
+}
+
+void delRead(void * privdata)
+{
+    event_del(static_cast<RedisEvents *>(privdata)->read_);
+}
+
+void addWrite(void * privdata)
+{
+    event_add(static_cast<RedisEvents *>(privdata)->write_, nullptr);
+}
+
+void delWrite(void * privdata)
+{
+    event_del(static_cast<RedisEvents *>(privdata)->write_);
+}
+
+void cleanup(void * privdata)
+{
+    RedisEvents * events = static_cast<RedisEvents *>(privdata);
+    event_free(events->read_);
+    event_free(events->write_);
+    delete events;
+}
+
+//the adapters/libevent.h of hiredis-vip is on the libevent 1 api, this is its event2 version
+int attachLoop(redisAsyncContext * ac, void * base)
+{
+    if(ac->ev.data != nullptr)
+    {
+        return REDIS_ERR;
+    }
+
+    RedisEvents * events = new RedisEvents;
+    events->context_ = ac;
+    events->read_ = event_new(static_cast<struct event_base *>(base), ac->c.fd, EV_READ, handleRead, events);
+    events->write_ = event_new(static_cast<struct event_base *>(base), ac->c.fd, EV_WRITE, handleWrite, events);
+    ASSERT_ABORT(events->read_ && events->write_);
+
+    ac->ev.addRead = addRead;
+    ac->ev.delRead = delRead;
+    ac->ev.addWrite = addWrite;
+    ac->ev.delWrite = delWrite;
+    ac->ev.cleanup = cleanup;
+    ac->ev.data = events;
+    return REDIS_OK;
+}
+
+void onDisconnect(const redisAsyncContext * ac, int status)
+{
+    if(status != REDIS_OK)
+    {
+        LOG_WARN("redis node %s:%d disconnected:%s", ac->c.tcp.host, ac->c.tcp.port, ac->errstr ? ac->errstr : "");
+    }
+}
+
+RedisCallback stringCallback(const RedisStringCallback & cb)
+{
+    return [cb](redisReply * reply) {
+        std::string value;
+        if(reply && reply->type == REDIS_REPLY_STRING)
+        {
+            value.assign(reply->str, reply->len);
+        }
+        cb(reply && reply->type != REDIS_REPLY_ERROR, value);
+    };
+}
+
+RedisCallback integerCallback(const RedisIntegerCallback & cb)
+{
+    return [cb](redisReply * reply) {
+        bool ok = reply && reply->type == REDIS_REPLY_INTEGER;
+        cb(ok, ok ? static_cast<long>(reply->integer) : 0);
+    };
+}
+
+}
+
+AsyncRedisProxyConn::AsyncRedisProxyConn(EventLoop * loop, const char * addrs):
+    loop_(loop),
+    addrs_(addrs),
+    context_(nullptr),
+    pending_(0),
+    releasing_(false)
+{
+}
+
+AsyncRedisProxyConn::~AsyncRedisProxyConn()
+{
+    release();
+}
+
+bool AsyncRedisProxyConn::init()
+{
+    if(context_ != nullptr)
+    {
+        return true;
+    }
+
+    if(releasing_)
+    {
+        return false;
+    }
+
+    context_ = redisClusterAsyncConnect(addrs_.c_str(), HIRCLUSTER_FLAG_NULL);
+    if(!context_ || context_->err)
+    {
+        LOG_INFO("redisClusterAsyncConnect failed:%s", context_ ? context_->errstr : "");
+        release();
+        return false;
+    }
+
+    context_->data = this;
+    context_->adapter = loop_->get_event();
+    context_->attach_fn = attachLoop;
+    redisClusterAsyncSetDisconnectCallback(context_, onDisconnect);
+
+    LOG_INFO("connect redis async success!!!");
+    return true;
+}
+
+void AsyncRedisProxyConn::release()
+{
+    if(!context_)
+    {
+        return;
+    }
+
+    //the callbacks run now, with a null reply
+    redisClusterAsyncContext * context = context_;
+    releasing_ = true;
+    redisClusterAsyncFree(context);
+    context_ = nullptr;
+    releasing_ = false;
+}
+
+bool AsyncRedisProxyConn::prepare()
+{
+    loop_->assertInLoopThread();
+    return init();
+}
+
+bool AsyncRedisProxyConn::sent(RedisCallback * cb, int ret)
+{
+    if(ret != REDIS_OK)
+    {
+        LOG_DEBUG("redisClusterAsyncCommand failed:%s", context_->errstr);
+        delete cb;
+        return false;
+    }
+
+    ++pending_;
+    return true;
+}
+
+bool AsyncRedisProxyConn::command(const RedisCallback & cb, const char * format, ...)
+{
+    if(!prepare())
+    {
+        return false;
+    }
+
+    RedisCallback * privdata = new RedisCallback(cb);
+    va_list arglist;
+    va_start(arglist, format);
+    int ret = redisClustervAsyncCommand(context_, onReply, privdata, format, arglist);
+    va_end(arglist);
+
+    return sent(privdata, ret);
+}
+
+bool AsyncRedisProxyConn::commandArgv(const RedisCallback & cb, const std::vector<std::string> & args)
+{
+    if(args.empty() || !prepare())
+    {
+        return false;
+    }
+
+    std::vector<const char *> argv(args.size());
+    std::vector<size_t> argvlen(args.size());
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = args[i].data();
+        argvlen[i] = args[i].size();
+    }
+
+    RedisCallback * privdata = new RedisCallback(cb);
+    int ret = redisClusterAsyncCommandArgv(context_, onReply, privdata, static_cast<int>(args.size()), argv.data(), argvlen.data());
+    return sent(privdata, ret);
+}
+
+bool AsyncRedisProxyConn::get(const char * key, const RedisStringCallback & cb)
+{
+    return command(stringCallback(cb), "GET %s", key);
+}
+
+bool AsyncRedisProxyConn::set(const char * key, const char * value, const RedisCallback & cb)
+{
+    return command(cb, "SET %s %s", key, value);
+}
+
+bool AsyncRedisProxyConn::hget(const char * key, const char * item, const RedisStringCallback & cb)
+{
+    return command(stringCallback(cb), "HGET %s %s", key, item);
+}
+
+bool AsyncRedisProxyConn::hset(const char * key, const char * item, const char * value, const RedisCallback & cb)
+{
+    return command(cb, "HSET %s %s %s", key, item, value);
+}
+
+bool AsyncRedisProxyConn::exists(const char * key, const RedisIntegerCallback & cb)
+{
+    return command(integerCallback(cb), "EXISTS %s", key);
+}
+
+bool AsyncRedisProxyConn::sismember(const char * key, long item, const RedisIntegerCallback & cb)
+{
+    return command(integerCallback(cb), "SISMEMBER %s %ld", key, item);
+}
+
+bool AsyncRedisProxyConn::incrby(const char * key, long value, const RedisIntegerCallback & cb)
+{
+    return command(integerCallback(cb), "INCRBY %s %ld", key, value);
+}
+
+bool AsyncRedisProxyConn::hincrby(const char * key, const char * item, long value, const RedisIntegerCallback & cb)
+{
+    return command(integerCallback(cb), "HINCRBY %s %s %ld", key, item, value);
+}
+
+void AsyncRedisProxyConn::onReply(redisClusterAsyncContext * context, void * reply, void * privdata)
+{
+    AsyncRedisProxyConn * conn = static_cast<AsyncRedisProxyConn *>(context->data);
+    if(conn && conn->pending_ > 0)
+    {
+        --conn->pending_;
+    }
+
+    RedisCallback * cb = static_cast<RedisCallback *>(privdata);
+    if(*cb)
+    {
+        (*cb)(static_cast<redisReply *>(reply));
+    }
+    delete cb;
+}
@@ -0,0 +1,80 @@
+#ifndef _ASYNC_REDIS_PROXY_CONN_H_
+#define _ASYNC_REDIS_PROXY_CONN_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+class EventLoop;
+class AsyncRedisProxyConn;
+struct redisReply;
+struct redisClusterAsyncContext;
+
+typedef std::shared_ptr<AsyncRedisProxyConn> AsyncRedisProxyConnPtr;
+#define MakeAsyncRedisProxyConnPtr std::make_shared<AsyncRedisProxyConn>
+
+//reply is null if the command failed or the connection was lost, it is freed after the callback
+typedef std::function<void (redisReply * reply)> RedisCallback;
+typedef std::function<void (bool ok, const std::string & value)> RedisStringCallback;
+typedef std::function<void (bool ok, long value)> RedisIntegerCallback;
+
+/*
+   AsyncRedisProxyConn: the hiredis-vip cluster async api on an EventLoop
+
+   the connections to the nodes are watched by the event_base of the loop,
+   a command is routed to the node of the slot of its key and queued on that
+   connection without waiting for the replies before, the commands of one
+   loop iteration go out in one write per node; the callbacks run on the loop
+   in the order of the commands of each node
+
+   every call must be made in the loop thread, runInLoop from the others.
+   init() fetches the route table synchronously, like RedisProxyConn, so call
+   it before the loop gets busy; a MOVED reply fetches it again
+ */
+class AsyncRedisProxyConn
+{
+public:
+    AsyncRedisProxyConn(EventLoop * loop, const char * addrs);
+    ~AsyncRedisProxyConn();
+public:
+    bool init();
+
+    //the callbacks of the commands in flight get a null reply
+    void release();
+
+    bool command(const RedisCallback & cb, const char * format, ...);
+    bool commandArgv(const RedisCallback & cb, const std::vector<std::string> & args);
+
+    bool get(const char * key, const RedisStringCallback & cb);
+    bool set(const char * key, const char * value, const RedisCallback & cb = RedisCallback());
+    bool hget(const char * key, const char * item, const RedisStringCallback & cb);
+    bool hset(const char * key, const char * item, const char * value, const RedisCallback & cb = RedisCallback());
+    bool exists(const char * key, const RedisIntegerCallback & cb);
+    bool sismember(const char * key, long item, const RedisIntegerCallback & cb);
+    bool incrby(const char * key, long value, const RedisIntegerCallback & cb);
+    bool hincrby(const char * key, const char * item, long value, const RedisIntegerCallback & cb);
+
+    EventLoop * getLoop() const { return loop_; }
+
+    //the commands waiting for their replies
+    size_t pending() const { return pending_; }
+private:
+    AsyncRedisProxyConn(const AsyncRedisProxyConn &);
+    AsyncRedisProxyConn & operator=(const AsyncRedisProxyConn &);
+
+    //check the thread and connect, false if the command can't be sent
+    bool prepare();
+    //count a sent command, or free its callback if sending failed
+    bool sent(RedisCallback * cb, int ret);
+
+    static void onReply(redisClusterAsyncContext * context, void * reply, void * privdata);
+
+    EventLoop *                 loop_;
+    std::string                 addrs_;
+    redisClusterAsyncContext *  context_;
+    size_t                      pending_;
+    bool                        releasing_; // no reconnect from the callbacks run by release()
+};
+
+#endif //_ASYNC_REDIS_PROXY_CONN_H_
@@ -0,0 +1,236 @@
+#include "RedisCoalescer.h"
+
+#include <map>
+#include <chrono>
+#include <hiredis-vip/hircluster.h>
+#include "base/BaseUtil.h"
+
+namespace
+{
+
+//the keys of a MGET or the items of a HMGET, each once
+struct Group
+{
+    Group():command_(0) {}
+
+    size_t add(const std::string & arg)
+    {
+        std::map<std::string, size_t>::iterator it = index_.find(arg);
+        if(it != index_.end())
+        {
+            return it->second;
+        }
+
+        args_.push_back(arg);
+        index_[arg] = args_.size() - 1;
+        return args_.size() - 1;
+    }
+
+    std::vector<std::string> args_;
+    std::map<std::string, size_t> index_;
+    size_t command_;
+};
+
+std::string formatArgv(const std::vector<std::string> & args)
+{
+    std::vector<const char *> argv(args.size());
+    std::vector<size_t> argvlen(args.size());
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = args[i].data();
+        argvlen[i] = args[i].size();
+    }
+
+    std::string command;
+    char * cmd = nullptr;
+    int len = redisFormatCommandArgv(&cmd, static_cast<int>(args.size()), argv.data(), argvlen.data());
+    if(len > 0)
+    {
+        command.assign(cmd, len);
+        free(cmd);
+    }
+
+    return command;
+}
+
+//false for an error or no reply, nil is an empty value
+bool assignString(const redisReply * reply, std::string & value)
+{
+    if(!reply || reply->type == REDIS_REPLY_ERROR)
+    {
+        return false;
+    }
+
+    if(reply->type == REDIS_REPLY_STRING)
+    {
+        value.assign(reply->str, reply->len);
+    }
+    return true;
+}
+
+}
+
+RedisCoalescer::RedisCoalescer(const char * addrs, int windowUs, size_t maxBatch):
+    windowUs_(windowUs),
+    maxBatch_(MAX_VALUE(maxBatch, static_cast<size_t>(1))),
+    gathering_(false),
+    callers_(0),
+    conn_(addrs)
+{
+}
+
+RedisCoalescer::~RedisCoalescer()
+{
+}
+
+bool RedisCoalescer::get(const std::string & key, std::string & value)
+{
+    return submit(key, nullptr, value);
+}
+
+bool RedisCoalescer::hget(const std::string & key, const std::string & item, std::string & value)
+{
+    return submit(key, &item, value);
+}
+
+std::string RedisCoalescer::get(const std::string & key)
+{
+    std::string value;
+    submit(key, nullptr, value);
+    return value;
+}
+
+std::string RedisCoalescer::hget(const std::string & key, const std::string & item)
+{
+    std::string value;
+    submit(key, &item, value);
+    return value;
+}
+
+bool RedisCoalescer::submit(const std::string & key, const std::string * item, std::string & value)
+{
+    Call call;
+    call.key_ = &key;
+    call.item_ = item;
+    call.ok_ = false;
+    call.done_ = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++callers_;
+    calls_.push_back(&call);
+    if(gathering_)
+    {
+        if(calls_.size() >= maxBatch_)
+        {
+            full_.notify_one();
+        }
+
+        done_.wait(lock, [&call]() { return call.done_; });
+        --callers_;
+        value.swap(call.value_);
+        return call.ok_;
+    }
+
+    //the leader of this window gathers the calls, then sends them;
+    //alone there is nobody to wait for
+    gathering_ = true;
+    if(callers_ > 1)
+    {
+        full_.wait_for(lock, std::chrono::microseconds(windowUs_), [this]() { return calls_.size() >= maxBatch_; });
+    }
+
+    std::vector<Call *> calls;
+    calls.swap(calls_);
+    gathering_ = false;
+    lock.unlock();
+
+    {
+        std::unique_lock<std::mutex> sendLock(sendMutex_);
+        flush(calls);
+    }
+
+    lock.lock();
+    for(size_t i = 0; i < calls.size(); ++i)
+    {
+        calls[i]->done_ = true;
+    }
+    done_.notify_all();
+    --callers_;
+    value.swap(call.value_);
+    return call.ok_;
+}
+
+void RedisCoalescer::flush(std::vector<Call *> & calls)
+{
+    //the GETs by slot, the HGETs by hash
+    std::map<int, Group> gets;
+    std::map<std::string, Group> hgets;
+    std::vector<std::pair<Group *, size_t> > args(calls.size());
+    for(size_t i = 0; i < calls.size(); ++i)
+    {
+        const Call * call = calls[i];
+        Group * group = nullptr;
+        if(call->item_)
+        {
+            group = &hgets[*call->key_];
+            args[i] = std::make_pair(group, group->add(*call->item_));
+        }
+        else
+        {
+            group = &gets[RedisProxyConn::keySlot(call->key_->data(), call->key_->size())];
+            args[i] = std::make_pair(group, group->add(*call->key_));
+        }
+    }
+
+    std::vector<std::string> commands;
+    std::vector<std::string> argv;
+    for(std::map<int, Group>::iterator it = gets.begin(); it != gets.end(); ++it)
+    {
+        Group & group = it->second;
+        argv.assign(1, group.args_.size() == 1 ? "GET" : "MGET");
+        argv.insert(argv.end(), group.args_.begin(), group.args_.end());
+        group.command_ = commands.size();
+        commands.push_back(formatArgv(argv));
+    }
+
+    for(std::map<std::string, Group>::iterator it = hgets.begin(); it != hgets.end(); ++it)
+    {
+        Group & group = it->second;
+        argv.assign(1, group.args_.size() == 1 ? "HGET" : "HMGET");
+        argv.push_back(it->first);
+        argv.insert(argv.end(), group.args_.begin(), group.args_.end());
+        group.command_ = commands.size();
+        commands.push_back(formatArgv(argv));
+    }
+
+    std::vector<redisReply *> replies;
+    conn_.pipeline(commands, replies);
+
+    //a single GET or HGET has the value itself, the others an array of them
+    for(size_t i = 0; i < calls.size(); ++i)
+    {
+        const Group * group = args[i].first;
+        const redisReply * reply = replies[group->command_];
+        if(group->args_.size() == 1)
+        {
+            calls[i]->ok_ = assignString(reply, calls[i]->value_);
+        }
+        else if(reply && reply->type == REDIS_REPLY_ARRAY && args[i].second < reply->elements)
+        {
+            calls[i]->ok_ = assignString(reply->element[args[i].second], calls[i]->value_);
+        }
+    }
+
+    for(size_t i = 0; i < replies.size(); ++i)
+    {
+        if(replies[i])
+        {
+            freeReplyObject(replies[i]);
+        }
+    }
+
+    RedisBatchStats & stats = RedisBatchStats::instance();
+    stats.coalesced_.fetch_add(calls.size(), std::memory_order_relaxed);
+    stats.merged_.fetch_add(commands.size(), std::memory_order_relaxed);
+    stats.savedRoundTrips_.fetch_add(calls.size() - commands.size(), std::memory_order_relaxed);
+}
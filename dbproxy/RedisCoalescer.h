@@ -0,0 +1,71 @@
+#ifndef _REDIS_COALESCER_H_
+#define _REDIS_COALESCER_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "RedisProxyConn.h"
+
+#define DEF_REDIS_COALESCE_WINDOW_US 200
+#define DEF_REDIS_COALESCE_MAX 256
+
+/*
+   RedisCoalescer: merge the GET and HGET of many threads into MGET and HMGET
+
+   the first caller of a window waits windowUs, or until maxBatch calls have
+   gathered, then sends them for all: the GETs of one slot become one MGET,
+   the HGETs of one hash one HMGET, all in one pipeline, a round trip per node;
+   the other callers only wait for their value. a window is sent while the
+   next one gathers, so a busy coalescer sends back to back
+
+   a caller alone in the coalescer sends at once, no window; with others
+   around get() and hget() block for up to a window and a round trip, that
+   is the price of the round trips saved, for the worker threads of a busy
+   process
+ */
+class RedisCoalescer
+{
+public:
+    RedisCoalescer(const char * addrs, int windowUs = DEF_REDIS_COALESCE_WINDOW_US, size_t maxBatch = DEF_REDIS_COALESCE_MAX);
+    ~RedisCoalescer();
+
+    //false if the command failed, an error reply or no connection;
+    //a key or an item not found is an empty value
+    bool get(const std::string & key, std::string & value);
+    bool hget(const std::string & key, const std::string & item, std::string & value);
+
+    //empty if not found or failed
+    std::string get(const std::string & key);
+    std::string hget(const std::string & key, const std::string & item);
+private:
+    RedisCoalescer(const RedisCoalescer &);
+    RedisCoalescer & operator=(const RedisCoalescer &);
+
+    struct Call
+    {
+        const std::string * key_;
+        const std::string * item_; // null for a GET
+        std::string value_;
+        bool ok_;
+        bool done_;
+    };
+
+    bool submit(const std::string & key, const std::string * item, std::string & value);
+    void flush(std::vector<Call *> & calls);
+
+    int windowUs_;
+    size_t maxBatch_;
+
+    std::mutex mutex_;
+    std::condition_variable full_; // the leader waits for the window to fill
+    std::condition_variable done_; // the followers wait for their values
+    bool gathering_;
+    size_t callers_; // in get() and hget() now, the window is skipped for one
+    std::vector<Call *> calls_;
+
+    std::mutex sendMutex_;
+    RedisProxyConn conn_;
+};
+
+#endif //_REDIS_COALESCER_H_
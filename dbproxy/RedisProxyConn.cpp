@@ -1,14 +1,119 @@
 #include "RedisProxyConn.h"
 
+#include <set>
+#include <stdarg.h>
 #include <hiredis-vip/hircluster.h>
 #include "base/BaseUtil.h"
+#include "base/Metrics.h"
 
 #define REDIS_CONNECT_TIMEOUT 200000
 
+namespace
+{
+
+//crc16 xmodem, the key hash of redis cluster
+uint16_t slotHash(const char * buf, size_t len)
+{
+    uint16_t crc = 0;
+    for(size_t i = 0; i < len; ++i)
+    {
+        crc ^= static_cast<uint16_t>(static_cast<uint8_t>(buf[i]) << 8);
+        for(int j = 0; j < 8; ++j)
+        {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+//the second argument of a command in the redis protocol, its key
+bool commandKey(const std::string & cmd, const char *& key, size_t & len)
+{
+    size_t pos = cmd.find("\r\n");
+    for(int arg = 0; arg < 2; ++arg)
+    {
+        if(pos == std::string::npos || pos + 3 >= cmd.size() || cmd[pos + 2] != '$')
+        {
+            return false;
+        }
+
+        size_t argLen = strtoul(cmd.c_str() + pos + 3, nullptr, 10);
+        size_t start = cmd.find("\r\n", pos + 2);
+        if(start == std::string::npos || start + 2 + argLen > cmd.size())
+        {
+            return false;
+        }
+
+        start += 2;
+        if(arg == 1)
+        {
+            key = cmd.data() + start;
+            len = argLen;
+            return true;
+        }
+        pos = start + argLen;
+    }
+
+    return false;
+}
+
+void statMaxShared(std::atomic<uint64_t> & stat, uint64_t n)
+{
+    uint64_t old = stat.load(std::memory_order_relaxed);
+    while(n > old && !stat.compare_exchange_weak(old, n, std::memory_order_relaxed))
+    {
+    }
+}
+
+struct BatchMetricDesc
+{
+    const char * name_;
+    const char * help_;
+    int gauge_;
+    std::atomic<uint64_t> RedisBatchStats::*stat_;
+};
+
+const BatchMetricDesc g_batchMetrics[] =
+{
+    { "gnet_redis_batches_total", "Redis pipelines sent.", 0, &RedisBatchStats::batches_ },
+    { "gnet_redis_batch_commands_total", "Commands sent in the pipelines.", 0, &RedisBatchStats::commands_ },
+    { "gnet_redis_batch_max_commands", "The largest pipeline sent.", 1, &RedisBatchStats::maxCommands_ },
+    { "gnet_redis_batch_round_trips_total", "Node round trips taken by the pipelines.", 0, &RedisBatchStats::roundTrips_ },
+    { "gnet_redis_coalesced_calls_total", "GET and HGET calls merged by the coalescers.", 0, &RedisBatchStats::coalesced_ },
+    { "gnet_redis_coalesced_commands_total", "The MGET and HMGET commands they became.", 0, &RedisBatchStats::merged_ },
+    { "gnet_redis_saved_round_trips_total", "Round trips saved against one per call.", 0, &RedisBatchStats::savedRoundTrips_ },
+};
+
+}
+
+RedisBatchStats & RedisBatchStats::instance()
+{
+    static RedisBatchStats stats;
+    static bool registered = (MetricsRegistry::instance().addScraper([](std::string & out) { stats.scrape(out); }), true);
+    NOTUSED_ARG(registered);
+    return stats;
+}
+
+void RedisBatchStats::scrape(std::string & out)
+{
+    char line[256];
+    for(size_t i = 0; i < sizeof(g_batchMetrics)/sizeof(g_batchMetrics[0]); ++i)
+    {
+        const BatchMetricDesc & desc = g_batchMetrics[i];
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", desc.name_, desc.help_,
+                 desc.name_, desc.gauge_ ? "gauge" : "counter",
+                 desc.name_, static_cast<unsigned long long>((this->*desc.stat_).load(std::memory_order_relaxed)));
+        out.append(line);
+    }
+}
+
 RedisProxyConn::RedisProxyConn(const char * addrs):
     addrs_(addrs),
     context_(nullptr)
 {
+    //the batch metrics are scraped from the first conn on
+    RedisBatchStats::instance();
     init();
 }
 
@@ -642,3 +747,232 @@ bool RedisProxyConn::persist(const char * key)
     freeReplyObject(reply);
     return ret_value;
 }
+
+bool RedisProxyConn::pipeline(const std::vector<std::string> & commands, std::vector<redisReply *> & replies)
+{
+    replies.assign(commands.size(), nullptr);
+    if(commands.empty())
+    {
+        return true;
+    }
+
+    if(!init())
+    {
+        return false;
+    }
+
+    //the commands go to the buffers of their nodes, the first reply read from a node flushes them all
+    std::vector<size_t> sent;
+    std::set<cluster_node *> nodes;
+    std::string cmd;
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        if(commands[i].empty())
+        {
+            continue;
+        }
+
+        cmd = commands[i];
+        if(redisClusterAppendFormattedCommand(context_, &cmd[0], static_cast<int>(cmd.size())) != REDIS_OK)
+        {
+            LOG_DEBUG("redisClusterAppendFormattedCommand failed:%s", context_->errstr);
+            continue;
+        }
+        sent.push_back(i);
+
+        const char * key = nullptr;
+        size_t len = 0;
+        if(commandKey(commands[i], key, len))
+        {
+            nodes.insert(context_->table[keySlot(key, len)]);
+        }
+    }
+
+    bool ok = true;
+    for(size_t i = 0; i < sent.size(); ++i)
+    {
+        void * reply = nullptr;
+        if(redisClusterGetReply(context_, &reply) != REDIS_OK || !reply)
+        {
+            ok = false;
+            break;
+        }
+        replies[sent[i]] = static_cast<redisReply *>(reply);
+    }
+
+    redisClusterReset(context_);
+    if(!ok)
+    {
+        release();
+    }
+
+    if(!sent.empty())
+    {
+        uint64_t roundTrips = MAX_VALUE(nodes.size(), static_cast<size_t>(1));
+        RedisBatchStats & stats = RedisBatchStats::instance();
+        stats.batches_.fetch_add(1, std::memory_order_relaxed);
+        stats.commands_.fetch_add(sent.size(), std::memory_order_relaxed);
+        statMaxShared(stats.maxCommands_, sent.size());
+        stats.roundTrips_.fetch_add(roundTrips, std::memory_order_relaxed);
+        stats.savedRoundTrips_.fetch_add(sent.size() - roundTrips, std::memory_order_relaxed);
+    }
+
+    return ok;
+}
+
+int RedisProxyConn::keySlot(const char * key, size_t len)
+{
+    //only the part in the first {} with something inside is hashed
+    const char * open = static_cast<const char *>(memchr(key, '{', len));
+    if(open)
+    {
+        size_t rest = len - (open - key) - 1;
+        const char * close = static_cast<const char *>(memchr(open + 1, '}', rest));
+        if(close && close > open + 1)
+        {
+            return slotHash(open + 1, close - open - 1) & (REDIS_CLUSTER_SLOTS - 1);
+        }
+    }
+
+    return slotHash(key, len) & (REDIS_CLUSTER_SLOTS - 1);
+}
+
+RedisBatch::RedisBatch(RedisProxyConn & conn):
+    conn_(conn)
+{
+}
+
+RedisBatch::~RedisBatch()
+{
+    freeReplies();
+}
+
+size_t RedisBatch::append(char * cmd, int len)
+{
+    //a command that can't be formatted keeps its index, with a null reply
+    if(len > 0)
+    {
+        commands_.emplace_back(cmd, len);
+        free(cmd);
+    }
+    else
+    {
+        commands_.emplace_back();
+    }
+
+    return commands_.size() - 1;
+}
+
+size_t RedisBatch::command(const char * format, ...)
+{
+    char * cmd = nullptr;
+    va_list arglist;
+    va_start(arglist, format);
+    int len = redisvFormatCommand(&cmd, format, arglist);
+    va_end(arglist);
+
+    return append(cmd, len);
+}
+
+size_t RedisBatch::commandArgv(const std::vector<std::string> & args)
+{
+    std::vector<const char *> argv(args.size());
+    std::vector<size_t> argvlen(args.size());
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = args[i].data();
+        argvlen[i] = args[i].size();
+    }
+
+    char * cmd = nullptr;
+    int len = args.empty() ? -1 : redisFormatCommandArgv(&cmd, static_cast<int>(args.size()), argv.data(), argvlen.data());
+    return append(cmd, len);
+}
+
+size_t RedisBatch::exists(const char * key)
+{
+    return command("EXISTS %s", key);
+}
+
+size_t RedisBatch::get(const char * key)
+{
+    return command("GET %s", key);
+}
+
+size_t RedisBatch::hget(const char * key, const char * item)
+{
+    return command("HGET %s %s", key, item);
+}
+
+size_t RedisBatch::hexists(const char * key, const char * item)
+{
+    return command("HEXISTS %s %s", key, item);
+}
+
+size_t RedisBatch::sismember(const char * key, long item)
+{
+    return command("SISMEMBER %s %ld", key, item);
+}
+
+size_t RedisBatch::scard(const char * key)
+{
+    return command("SCARD %s", key);
+}
+
+size_t RedisBatch::incr(const char * key)
+{
+    return command("INCR %s", key);
+}
+
+size_t RedisBatch::incrby(const char * key, long value)
+{
+    return command("INCRBY %s %ld", key, value);
+}
+
+size_t RedisBatch::hincrby(const char * key, const char * item, long value)
+{
+    return command("HINCRBY %s %s %ld", key, item, value);
+}
+
+bool RedisBatch::exec()
+{
+    freeReplies();
+    bool ok = conn_.pipeline(commands_, replies_);
+    commands_.clear();
+    return ok;
+}
+
+void RedisBatch::clear()
+{
+    commands_.clear();
+    freeReplies();
+}
+
+const redisReply * RedisBatch::reply(size_t index) const
+{
+    return index < replies_.size() ? replies_[index] : nullptr;
+}
+
+std::string RedisBatch::str(size_t index) const
+{
+    const redisReply * r = reply(index);
+    return r && r->type == REDIS_REPLY_STRING ? std::string(r->str, r->len) : std::string();
+}
+
+long RedisBatch::integer(size_t index, long defValue) const
+{
+    const redisReply * r = reply(index);
+    return r && r->type == REDIS_REPLY_INTEGER ? static_cast<long>(r->integer) : defValue;
+}
+
+void RedisBatch::freeReplies()
+{
+    for(size_t i = 0; i < replies_.size(); ++i)
+    {
+        if(replies_[i])
+        {
+            freeReplyObject(replies_[i]);
+        }
+    }
+    replies_.clear();
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <atomic>
 #include <memory>
 
 typedef std::vector<std::string> KeyList;
@@ -22,6 +23,29 @@ class redisClusterContext;
 typedef std::shared_ptr<RedisProxyConn> RedisProxyConnPtr;
 #define MakeRedisProxyConnPtr std::make_shared<RedisProxyConn>
 
+/*
+   the pipelining counters of all the RedisProxyConn, written by many threads;
+   a pipeline takes one round trip per node it reaches, a coalesced GET or
+   HGET shares its MGET or HMGET with the others
+ */
+struct RedisBatchStats
+{
+    RedisBatchStats():batches_(0), commands_(0), maxCommands_(0), roundTrips_(0), coalesced_(0), merged_(0), savedRoundTrips_(0) {}
+
+    std::atomic<uint64_t> batches_; // the pipelines sent
+    std::atomic<uint64_t> commands_; // the commands in them
+    std::atomic<uint64_t> maxCommands_; // the largest pipeline
+    std::atomic<uint64_t> roundTrips_; // the node round trips they took
+    std::atomic<uint64_t> coalesced_; // the GET and HGET calls merged
+    std::atomic<uint64_t> merged_; // the commands they were merged into
+    std::atomic<uint64_t> savedRoundTrips_; // against one round trip per call
+
+    static RedisBatchStats & instance();
+
+    //append the counters in the Prometheus text format, MetricsRegistry::scrape() does it too
+    void scrape(std::string & out);
+};
+
 class RedisProxyConn
 {
 public:
@@ -55,6 +79,14 @@ public:
     long hincrby(const char * key, const char * item, long value);
     bool expire_day(const char * key, int days);
     bool persist(const char * key);
+
+    //send the formatted commands at once, one round trip per node, and read
+    //their replies in order, to be freed by the caller; false if the
+    //connection failed, the replies not read are null
+    bool pipeline(const std::vector<std::string> & commands, std::vector<redisReply *> & replies);
+
+    //the cluster slot of a key, of its {hash tag} if it has one
+    static int keySlot(const char * key, size_t len);
 private:
     redisReply * _vcommand(const char * format, ...);
 
@@ -62,4 +94,61 @@ private:
     redisClusterContext *  context_;
 };
 
+/*
+   RedisBatch: queue the commands of a RedisProxyConn and send them at once,
+   exec() takes a round trip per node instead of one per command; the replies
+   are read by the index the queuing returned, until the next exec()
+
+    RedisBatch batch(conn);
+    size_t name = batch.hget("user:1", "name");
+    size_t visits = batch.incr("visits:1");
+    if(batch.exec())
+        use(batch.str(name), batch.integer(visits));
+ */
+class RedisBatch
+{
+public:
+    RedisBatch(RedisProxyConn & conn);
+    ~RedisBatch();
+
+    //queue a command, return the index of its reply
+    size_t command(const char * format, ...);
+    size_t commandArgv(const std::vector<std::string> & args);
+
+    size_t exists(const char * key);
+    size_t get(const char * key);
+    size_t hget(const char * key, const char * item);
+    size_t hexists(const char * key, const char * item);
+    size_t sismember(const char * key, long item);
+    size_t scard(const char * key);
+    size_t incr(const char * key);
+    size_t incrby(const char * key, long value);
+    size_t hincrby(const char * key, const char * item, long value);
+
+    size_t size() const { return commands_.size(); }
+
+    //send the queued commands and read the replies, the queue is empty after
+    bool exec();
+
+    //drop the queued commands and the replies
+    void clear();
+
+    //null if the command failed
+    const redisReply * reply(size_t index) const;
+    //empty unless the reply is a string
+    std::string str(size_t index) const;
+    //defValue unless the reply is an integer
+    long integer(size_t index, long defValue = 0) const;
+private:
+    RedisBatch(const RedisBatch &);
+    RedisBatch & operator=(const RedisBatch &);
+
+    size_t append(char * cmd, int len);
+    void freeReplies();
+
+    RedisProxyConn &           conn_;
+    std::vector<std::string>   commands_; // in the redis protocol
+    std::vector<redisReply *>  replies_;
+};
+
 #endif //_REDIS_PROXY_CONN_H_
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <vector>
+#include <string>
+
+#include "LogArgs.h"
+#include "Clock.h"
+
+/*
+   logdecode: turn the binary logs written with Binary=1 in log.conf back into
+   the text lines, the files are decoded in order to stdout, or stdin if none;
+   the files gzipped on roll with Compress set are read as they are; the times
+   are in the Timezone of log.conf, -t sets it here, +8 by default
+ */
+
+#define READ_BLOCK_SIZE 1024*1024
+
+static int decodeFile(gzFile fp, const char * name)
+{
+    LogBinaryReader reader;
+    std::vector<char> data;
+    std::string out;
+    size_t used = 0;
+
+    while(true)
+    {
+        size_t size = data.size();
+        data.resize(size + READ_BLOCK_SIZE);
+        int n = gzread(fp, data.data() + size, READ_BLOCK_SIZE);
+        if(n < 0)
+        {
+            int err = 0;
+            fprintf(stderr, "%s: %s\n", name, gzerror(fp, &err));
+            return -1;
+        }
+
+        data.resize(size + n);
+        if(n == 0)
+        {
+            break;
+        }
+
+        out.clear();
+        ssize_t len = reader.decode(data.data(), data.size(), out);
+        fwrite(out.data(), 1, out.size(), stdout);
+        if(len < 0)
+        {
+            fprintf(stderr, "%s: corrupted at offset %zu\n", name, used);
+            return -1;
+        }
+
+        //keep the partial entry for the next block
+        data.erase(data.begin(), data.begin() + len);
+        used += len;
+    }
+
+    if(!data.empty())
+    {
+        fprintf(stderr, "%s: %zu bytes truncated at offset %zu\n", name, data.size(), used);
+    }
+
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+    {
+        fprintf(stderr, "Usage: %s [-t +8|-3:30|local] [file.blog[.gz] ...]\n", argv[0]);
+        return 0;
+    }
+
+    int first = 1;
+    if(argc > 2 && strcmp(argv[1], "-t") == 0)
+    {
+        int offset = 0;
+        if(!Clock::parseTimezone(argv[2], offset))
+        {
+            fprintf(stderr, "bad timezone %s\n", argv[2]);
+            return 1;
+        }
+
+        Clock::setTimezone(offset);
+        first = 3;
+    }
+
+    if(argc == first)
+    {
+        gzFile fp = gzdopen(STDIN_FILENO, "rb");
+        int ret = fp && decodeFile(fp, "stdin") == 0 ? 0 : 1;
+        if(fp)
+        {
+            gzclose(fp);
+        }
+        return ret;
+    }
+
+    int ret = 0;
+    for(int i = first; i < argc; ++i)
+    {
+        gzFile fp = gzopen(argv[i], "rb");
+        if(!fp)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            ret = 1;
+            continue;
+        }
+
+        if(decodeFile(fp, argv[i]) != 0)
+        {
+            ret = 1;
+        }
+        gzclose(fp);
+    }
+
+    return ret;
+}
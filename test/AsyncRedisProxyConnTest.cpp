@@ -0,0 +1,144 @@
+/*
+   AsyncRedisProxyConnTest: AsyncRedisProxyConn against MockRedis
+
+   the replies of a pipeline come back in order in one round trip, the
+   commands in flight get a null reply when the server closes the
+   connection or release() is called, and the conn connects again after
+ */
+#include <stdio.h>
+#include <hiredis-vip/hircluster.h>
+#include "base/BaseUtil.h"
+#include "AsyncRedisProxyConn.h"
+#include "MockRedis.h"
+#include "TestUtil.h"
+
+namespace
+{
+
+void testPipeline(EventLoop & loop, AsyncRedisProxyConn & conn, MockRedis & redis)
+{
+    const int count = 2000;
+    char key[32];
+    char value[32];
+    for(int i = 0; i < count; ++i)
+    {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        CHECK(conn.set(key, value));
+    }
+
+    //the replies of the two commands interleave in the order they were sent
+    int replies = 0;
+    int bad = 0;
+    size_t reads = redis.reads();
+    for(int i = 0; i < count; ++i)
+    {
+        snprintf(key, sizeof(key), "key%d", i);
+        conn.get(key, [&, i](bool ok, const std::string & value) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "value%d", i);
+            bad += !ok || value != expected || replies != 2*i;
+            ++replies;
+        });
+        conn.incrby("counter", 1, [&, i](bool ok, long value) {
+            bad += !ok || value != i + 1 || replies != 2*i + 1;
+            if(++replies == 2*count)
+            {
+                loop.quit();
+            }
+        });
+    }
+
+    CHECK_EQ(conn.pending(), static_cast<size_t>(3*count));
+    loop.loop();
+    CHECK_EQ(replies, 2*count);
+    CHECK_EQ(bad, 0);
+    CHECK_EQ(conn.pending(), 0u);
+    //a few reads, not one per command
+    CHECK(redis.reads() - reads < 100);
+    printf("pipeline: %d commands in %zu server reads\n", 3*count, redis.reads() - reads);
+}
+
+void testDisconnect(EventLoop & loop, AsyncRedisProxyConn & conn, MockRedis & redis)
+{
+    //the server closes the connection on __close__, the commands after it get null
+    int nulls = 0;
+    conn.command([&](redisReply * reply) { nulls += reply == nullptr; }, "GET __close__");
+    conn.get("key1", [&](bool ok, const std::string & value) {
+        nulls += !ok && value.empty();
+        loop.quit();
+    });
+    loop.loop();
+    CHECK_EQ(nulls, 2);
+    CHECK_EQ(conn.pending(), 0u);
+
+    //the next command connects again
+    size_t conns = redis.conns();
+    std::string value;
+    conn.get("key1", [&](bool ok, const std::string & v) {
+        CHECK(ok);
+        value = v;
+        loop.quit();
+    });
+    loop.loop();
+    CHECK_EQ(value, "value1");
+    CHECK(redis.conns() > conns);
+}
+
+void testRelease(EventLoop & loop, AsyncRedisProxyConn & conn)
+{
+    //release() runs the callbacks of the commands in flight, with a null reply
+    int released = 0;
+    for(int i = 0; i < 5; ++i)
+    {
+        conn.get("key2", [&](bool ok, const std::string &) { released += !ok; });
+    }
+    CHECK_EQ(conn.pending(), 5u);
+
+    conn.release();
+    CHECK_EQ(released, 5);
+    CHECK_EQ(conn.pending(), 0u);
+
+    //and a conn released is usable again
+    long value = 0;
+    conn.hset("hash", "field", "1");
+    conn.hincrby("hash", "field", 5, [&](bool ok, long v) {
+        CHECK(ok);
+        value = v;
+        loop.quit();
+    });
+    loop.loop();
+    CHECK_EQ(value, 6);
+}
+
+void testUnrouted(AsyncRedisProxyConn & conn)
+{
+    //a command without a key has no slot, hiredis-vip refuses it
+    bool called = false;
+    CHECK(!conn.command([&](redisReply *) { called = true; }, "PING"));
+    CHECK(!called);
+    CHECK_EQ(conn.pending(), 0u);
+}
+
+}
+
+int main()
+{
+    MockRedis redis;
+    if(!redis.start())
+    {
+        fprintf(stderr, "mock redis failed to start\n");
+        return 1;
+    }
+
+    EventLoop loop;
+    AsyncRedisProxyConn conn(&loop, redis.addr().c_str());
+    CHECK(conn.init());
+
+    testPipeline(loop, conn, redis);
+    testDisconnect(loop, conn, redis);
+    testRelease(loop, conn);
+    testUnrouted(conn);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,357 @@
+#include "MockRedis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace
+{
+
+std::string bulk(const std::string & value)
+{
+    char head[32];
+    snprintf(head, sizeof(head), "$%zu\r\n", value.size());
+    return head + value + "\r\n";
+}
+
+std::string integer(long long value)
+{
+    char line[32];
+    snprintf(line, sizeof(line), ":%lld\r\n", value);
+    return line;
+}
+
+std::string arrayHead(size_t size)
+{
+    char head[32];
+    snprintf(head, sizeof(head), "*%zu\r\n", size);
+    return head;
+}
+
+const char * Nil = "$-1\r\n";
+
+//a missing key reads as empty and is not created
+template<typename Map>
+const typename Map::mapped_type & find(const Map & map, const std::string & key)
+{
+    static const typename Map::mapped_type empty;
+    typename Map::const_iterator it = map.find(key);
+    return it == map.end() ? empty : it->second;
+}
+
+bool is(const std::string & arg, const char * name)
+{
+    return strcasecmp(arg.c_str(), name) == 0;
+}
+
+}
+
+MockRedis::MockRedis():
+    listenFd_(-1),
+    port_(0),
+    running_(false),
+    reads_(0),
+    commands_(0),
+    conns_(0)
+{
+}
+
+MockRedis::~MockRedis()
+{
+    running_ = false;
+    if(thread_.joinable())
+    {
+        thread_.join();
+    }
+
+    if(listenFd_ >= 0)
+    {
+        ::close(listenFd_);
+    }
+}
+
+bool MockRedis::start()
+{
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(listenFd_ < 0)
+    {
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(::bind(listenFd_, reinterpret_cast<struct sockaddr *>(&addr), len) != 0
+       || ::listen(listenFd_, 64) != 0
+       || ::getsockname(listenFd_, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0)
+    {
+        return false;
+    }
+
+    port_ = ntohs(addr.sin_port);
+    running_ = true;
+    thread_ = std::thread(&MockRedis::threadFunc, this);
+    return true;
+}
+
+std::string MockRedis::addr() const
+{
+    char addr[32];
+    snprintf(addr, sizeof(addr), "127.0.0.1:%d", port_);
+    return addr;
+}
+
+void MockRedis::threadFunc()
+{
+    std::vector<Conn> conns;
+    std::vector<struct pollfd> fds;
+    while(running_)
+    {
+        fds.clear();
+        struct pollfd listenPoll = { listenFd_, POLLIN, 0 };
+        fds.push_back(listenPoll);
+        for(size_t i = 0; i < conns.size(); ++i)
+        {
+            struct pollfd connPoll = { conns[i].fd_, POLLIN, 0 };
+            fds.push_back(connPoll);
+        }
+
+        //wake up now and then to see running_
+        if(::poll(fds.data(), fds.size(), 10) <= 0)
+        {
+            continue;
+        }
+
+        for(size_t i = conns.size(); i > 0; --i)
+        {
+            if(fds[i].revents && !onRead(conns[i - 1]))
+            {
+                ::close(conns[i - 1].fd_);
+                conns.erase(conns.begin() + (i - 1));
+            }
+        }
+
+        if(fds[0].revents & POLLIN)
+        {
+            Conn conn;
+            conn.fd_ = ::accept(listenFd_, nullptr, nullptr);
+            if(conn.fd_ >= 0)
+            {
+                ++conns_;
+                conns.push_back(conn);
+            }
+        }
+    }
+
+    for(size_t i = 0; i < conns.size(); ++i)
+    {
+        ::close(conns[i].fd_);
+    }
+}
+
+bool MockRedis::onRead(Conn & conn)
+{
+    char buf[65536];
+    ssize_t n = ::read(conn.fd_, buf, sizeof(buf));
+    if(n <= 0)
+    {
+        return false;
+    }
+
+    ++reads_;
+    conn.input_.append(buf, n);
+
+    std::string output;
+    std::vector<std::string> args;
+    while(parse(conn.input_, args))
+    {
+        if(args.size() == 2 && is(args[0], "GET") && args[1] == "__close__")
+        {
+            return false;
+        }
+
+        ++commands_;
+        output += run(args);
+    }
+
+    for(size_t sent = 0; sent < output.size(); )
+    {
+        ssize_t w = ::write(conn.fd_, output.data() + sent, output.size() - sent);
+        if(w <= 0)
+        {
+            return false;
+        }
+        sent += w;
+    }
+
+    return true;
+}
+
+bool MockRedis::parse(std::string & input, std::vector<std::string> & args)
+{
+    args.clear();
+    if(input.empty() || input[0] != '*')
+    {
+        return false;
+    }
+
+    size_t end = input.find("\r\n");
+    if(end == std::string::npos)
+    {
+        return false;
+    }
+
+    size_t count = strtoul(input.c_str() + 1, nullptr, 10);
+    size_t pos = end + 2;
+    for(size_t i = 0; i < count; ++i)
+    {
+        end = input.find("\r\n", pos);
+        if(end == std::string::npos || input[pos] != '$')
+        {
+            return false;
+        }
+
+        size_t len = strtoul(input.c_str() + pos + 1, nullptr, 10);
+        pos = end + 2;
+        if(input.size() < pos + len + 2)
+        {
+            return false;
+        }
+
+        args.push_back(input.substr(pos, len));
+        pos += len + 2;
+    }
+
+    input.erase(0, pos);
+    return true;
+}
+
+std::string MockRedis::run(const std::vector<std::string> & args)
+{
+    const std::string & cmd = args[0];
+    if(is(cmd, "CLUSTER"))
+    {
+        char nodes[128];
+        snprintf(nodes, sizeof(nodes), "0123456789abcdef0123456789abcdef01234567 127.0.0.1:%d myself,master - 0 0 1 connected 0-16383\n", port_);
+        return bulk(nodes);
+    }
+
+    if(is(cmd, "PING"))
+    {
+        return "+PONG\r\n";
+    }
+
+    if(is(cmd, "SET") && args.size() == 3)
+    {
+        strings_[args[1]] = args[2];
+        return "+OK\r\n";
+    }
+
+    if(is(cmd, "GET") && args.size() == 2)
+    {
+        std::map<std::string, std::string>::iterator it = strings_.find(args[1]);
+        return it == strings_.end() ? Nil : bulk(it->second);
+    }
+
+    if(is(cmd, "MGET"))
+    {
+        std::string reply = arrayHead(args.size() - 1);
+        for(size_t i = 1; i < args.size(); ++i)
+        {
+            std::map<std::string, std::string>::iterator it = strings_.find(args[i]);
+            reply += it == strings_.end() ? Nil : bulk(it->second);
+        }
+        return reply;
+    }
+
+    if((is(cmd, "INCR") && args.size() == 2) || (is(cmd, "INCRBY") && args.size() == 3))
+    {
+        long long value = atoll(strings_[args[1]].c_str()) + (args.size() == 3 ? atoll(args[2].c_str()) : 1);
+        strings_[args[1]] = std::to_string(value);
+        return integer(value);
+    }
+
+    if(is(cmd, "EXISTS") && args.size() == 2)
+    {
+        return integer(strings_.count(args[1]) + hashes_.count(args[1]) + sets_.count(args[1]));
+    }
+
+    if(is(cmd, "DEL"))
+    {
+        long long n = 0;
+        for(size_t i = 1; i < args.size(); ++i)
+        {
+            n += strings_.erase(args[i]) + hashes_.erase(args[i]) + sets_.erase(args[i]);
+        }
+        return integer(n);
+    }
+
+    if(is(cmd, "HSET") && args.size() == 4)
+    {
+        std::map<std::string, std::string> & hash = hashes_[args[1]];
+        bool added = hash.find(args[2]) == hash.end();
+        hash[args[2]] = args[3];
+        return integer(added);
+    }
+
+    if((is(cmd, "HGET") || is(cmd, "HEXISTS")) && args.size() == 3)
+    {
+        const std::map<std::string, std::string> & hash = find(hashes_, args[1]);
+        std::map<std::string, std::string>::const_iterator it = hash.find(args[2]);
+        if(is(cmd, "HEXISTS"))
+        {
+            return integer(it != hash.end());
+        }
+        return it == hash.end() ? Nil : bulk(it->second);
+    }
+
+    if(is(cmd, "HMGET") && args.size() >= 3)
+    {
+        const std::map<std::string, std::string> & hash = find(hashes_, args[1]);
+        std::string reply = arrayHead(args.size() - 2);
+        for(size_t i = 2; i < args.size(); ++i)
+        {
+            std::map<std::string, std::string>::const_iterator it = hash.find(args[i]);
+            reply += it == hash.end() ? Nil : bulk(it->second);
+        }
+        return reply;
+    }
+
+    if(is(cmd, "HINCRBY") && args.size() == 4)
+    {
+        std::string & field = hashes_[args[1]][args[2]];
+        long long value = atoll(field.c_str()) + atoll(args[3].c_str());
+        field = std::to_string(value);
+        return integer(value);
+    }
+
+    if(is(cmd, "SADD") && args.size() >= 3)
+    {
+        long long n = 0;
+        for(size_t i = 2; i < args.size(); ++i)
+        {
+            n += sets_[args[1]].insert(args[i]).second;
+        }
+        return integer(n);
+    }
+
+    if(is(cmd, "SISMEMBER") && args.size() == 3)
+    {
+        return integer(find(sets_, args[1]).count(args[2]));
+    }
+
+    if(is(cmd, "SCARD") && args.size() == 2)
+    {
+        return integer(find(sets_, args[1]).size());
+    }
+
+    return "-ERR unknown command '" + cmd + "'\r\n";
+}
@@ -0,0 +1,65 @@
+#ifndef _MOCK_REDIS_H_
+#define _MOCK_REDIS_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <thread>
+
+/*
+   MockRedis: a one node redis cluster on 127.0.0.1, for the tests of the
+   redis conns
+
+   CLUSTER NODES gives all the slots to itself, the strings, hashes and sets
+   commands the conns use work on a map; the replies to the commands of one
+   read go out in one write, so reads() tells how many round trips a client
+   took. GET __close__ closes the connection without a reply
+ */
+class MockRedis
+{
+public:
+    MockRedis();
+    ~MockRedis();
+
+    //listen on a free port and serve on a thread
+    bool start();
+
+    std::string addr() const;
+
+    size_t reads() const { return reads_.load(); }
+    size_t commands() const { return commands_.load(); }
+    size_t conns() const { return conns_.load(); }
+private:
+    MockRedis(const MockRedis &);
+    MockRedis & operator=(const MockRedis &);
+
+    struct Conn
+    {
+        int fd_;
+        std::string input_;
+    };
+
+    void threadFunc();
+    //false when the conn must be closed
+    bool onRead(Conn & conn);
+    //the next complete command of the input, false if it isn't all there
+    bool parse(std::string & input, std::vector<std::string> & args);
+    std::string run(const std::vector<std::string> & args);
+
+    int listenFd_;
+    int port_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+
+    std::atomic<size_t> reads_;
+    std::atomic<size_t> commands_;
+    std::atomic<size_t> conns_;
+
+    std::map<std::string, std::string> strings_;
+    std::map<std::string, std::map<std::string, std::string> > hashes_;
+    std::map<std::string, std::set<std::string> > sets_;
+};
+
+#endif // _MOCK_REDIS_H_
@@ -0,0 +1,192 @@
+/*
+   RedisBatchTest: the cluster slot of the keys, RedisBatch pipelines and
+   the reply fan-out of RedisCoalescer, against MockRedis
+ */
+#include <stdio.h>
+#include <thread>
+#include <hiredis-vip/hircluster.h>
+#include "base/BaseUtil.h"
+#include "base/Metrics.h"
+#include "RedisProxyConn.h"
+#include "RedisCoalescer.h"
+#include "MockRedis.h"
+#include "TestUtil.h"
+
+namespace
+{
+
+int slot(const char * key)
+{
+    return RedisProxyConn::keySlot(key, strlen(key));
+}
+
+void testKeySlot()
+{
+    //the CRC16 check value, and the examples of the cluster spec
+    CHECK_EQ(slot("123456789"), 0x31C3);
+    CHECK_EQ(slot("foo"), 12182);
+    CHECK_EQ(slot("bar"), 5061);
+    CHECK_EQ(slot(""), 0);
+
+    //only the first {} with something inside is hashed
+    CHECK_EQ(slot("{user1000}.following"), slot("user1000"));
+    CHECK_EQ(slot("{user1000}.followers"), slot("user1000"));
+    CHECK(slot("foo{}{bar}") != slot("bar"));
+    CHECK_EQ(slot("foo{{bar}}zap"), slot("{bar"));
+    CHECK_EQ(slot("foo{bar}{zap}"), slot("bar"));
+    CHECK(slot("{foo") != slot("foo"));
+}
+
+void testBatch(RedisProxyConn & conn, MockRedis & redis)
+{
+    RedisBatch seed(conn);
+    seed.command("SET name %s", "gnet");
+    seed.command("HSET user:1 city %s", "hangzhou");
+    seed.command("SADD set:1 1 2 3");
+    CHECK(seed.exec());
+
+    RedisBatch batch(conn);
+    size_t name = batch.get("name");
+    size_t city = batch.hget("user:1", "city");
+    size_t ping = batch.command("PING"); // no key, hiredis-vip can't route it
+    size_t missing = batch.get("missing");
+    size_t counter = batch.incrby("counter", 5);
+    size_t member = batch.sismember("set:1", 2);
+    size_t card = batch.scard("set:1");
+    size_t hexists = batch.hexists("user:1", "city");
+    size_t argv = batch.commandArgv(std::vector<std::string>{ "GET", "name" });
+    CHECK_EQ(batch.size(), 9u);
+
+    CHECK(batch.exec());
+    CHECK_EQ(batch.size(), 0u);
+    CHECK_EQ(batch.str(name), "gnet");
+    CHECK_EQ(batch.str(city), "hangzhou");
+    CHECK(batch.reply(ping) == nullptr);
+    CHECK(batch.reply(missing) != nullptr && batch.reply(missing)->type == REDIS_REPLY_NIL);
+    CHECK_EQ(batch.integer(counter), 5);
+    CHECK_EQ(batch.integer(member), 1);
+    CHECK_EQ(batch.integer(card), 3);
+    CHECK_EQ(batch.integer(hexists), 1);
+    CHECK_EQ(batch.str(argv), "gnet");
+    CHECK_EQ(batch.integer(name, -1), -1);
+    CHECK(batch.reply(100) == nullptr);
+
+    //a thousand commands take a few round trips, not a thousand
+    size_t reads = redis.reads();
+    char key[32];
+    for(int i = 0; i < 1000; ++i)
+    {
+        snprintf(key, sizeof(key), "key%d", i);
+        batch.incr(key);
+    }
+    CHECK(batch.exec());
+    CHECK_EQ(batch.integer(999), 1);
+    CHECK(redis.reads() - reads < 20);
+    printf("batch: 1000 commands in %zu server reads\n", redis.reads() - reads);
+
+    RedisBatchStats & stats = RedisBatchStats::instance();
+    CHECK(stats.batches_.load() >= 3);
+    CHECK(stats.maxCommands_.load() >= 1000);
+}
+
+void testCoalescer(RedisProxyConn & conn, MockRedis & redis)
+{
+    RedisBatch seed(conn);
+    char key[32];
+    char value[32];
+    for(int i = 0; i < 64; ++i)
+    {
+        snprintf(key, sizeof(key), "ckey%d", i);
+        snprintf(value, sizeof(value), "cvalue%d", i);
+        seed.command("SET %s %s", key, value);
+        seed.command("HSET chash %s %s", key, value);
+    }
+    CHECK(seed.exec());
+
+    RedisCoalescer coalescer(redis.addr().c_str());
+
+    //alone: the value, an empty one for a missing key, no window
+    std::string found;
+    CHECK(coalescer.get("ckey1", found));
+    CHECK_EQ(found, "cvalue1");
+    CHECK(coalescer.get("missing", found));
+    CHECK(found.empty());
+    CHECK(coalescer.hget("chash", "ckey2", found));
+    CHECK_EQ(found, "cvalue2");
+    CHECK_EQ(coalescer.hget("chash", "missing"), "");
+
+    //many threads on the same and different keys, each gets its own value
+    const int threads = 16;
+    const int calls = 500;
+    std::atomic<int> bad(0);
+    size_t commands = redis.commands();
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&coalescer, &bad, t]() {
+            char key[32];
+            char expected[32];
+            std::string value;
+            for(int i = 0; i < calls; ++i)
+            {
+                int n = (t*7 + i) % 64;
+                snprintf(key, sizeof(key), "ckey%d", n);
+                snprintf(expected, sizeof(expected), "cvalue%d", n);
+                bool ok = i % 2 ? coalescer.get(key, value) : coalescer.hget("chash", key, value);
+                bad += !ok || value != expected;
+            }
+        });
+    }
+    for(size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+
+    CHECK_EQ(bad.load(), 0);
+    CHECK(redis.commands() - commands < static_cast<size_t>(threads*calls));
+    printf("coalescer: %d calls in %zu commands\n", threads*calls, redis.commands() - commands);
+
+    RedisBatchStats & stats = RedisBatchStats::instance();
+    CHECK(stats.coalesced_.load() >= static_cast<uint64_t>(threads*calls));
+    CHECK(stats.merged_.load() < stats.coalesced_.load());
+
+    std::string scrape;
+    MetricsRegistry::instance().scrape(scrape);
+    CHECK(scrape.find("gnet_redis_coalesced_calls_total") != std::string::npos);
+    CHECK(scrape.find("gnet_redis_batch_max_commands") != std::string::npos);
+}
+
+void testFailure()
+{
+    //nothing listens there, the calls fail instead of looking like a missing key
+    RedisCoalescer coalescer("127.0.0.1:1");
+    std::string value;
+    CHECK(!coalescer.get("key", value));
+    CHECK(!coalescer.hget("hash", "item", value));
+
+    RedisProxyConn conn("127.0.0.1:1");
+    RedisBatch batch(conn);
+    size_t index = batch.get("key");
+    CHECK(!batch.exec());
+    CHECK(batch.reply(index) == nullptr);
+}
+
+}
+
+int main()
+{
+    MockRedis redis;
+    if(!redis.start())
+    {
+        fprintf(stderr, "mock redis failed to start\n");
+        return 1;
+    }
+
+    RedisProxyConn conn(redis.addr().c_str());
+    testKeySlot();
+    testBatch(conn, redis);
+    testCoalescer(conn, redis);
+    testFailure();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,23 @@
+#ifndef _TEST_UTIL_H_
+#define _TEST_UTIL_H_
+
+#include <stdio.h>
+
+//the failed checks of the test, main() returns TEST_RESULT()
+static int g_testFailures = 0;
+
+#define CHECK(c) \
+    do \
+    { \
+        if(!(c)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #c); \
+            ++g_testFailures; \
+        } \
+    } while(0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+#define TEST_RESULT() (g_testFailures == 0 ? (printf("all checks passed\n"), 0) : (printf("%d checks failed\n", g_testFailures), 1))
+
+#endif // _TEST_UTIL_H_